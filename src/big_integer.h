@@ -0,0 +1,652 @@
+# ifndef BIG_INTEGER_H_
+# define BIG_INTEGER_H_
+# include <vector>
+# include <string>
+# include <cstdint>
+# include <algorithm>
+# include <random>
+# include <chrono>
+# include <climits>
+# include <iostream>
+# include "thread_pool.h"
+/**
+ * @brief signed arbitrary precision integer stored as base 10^9 limbs, least significant first,
+ * so decimal conversion is linear and only happens at the edges. Arithmetic kernels work in place
+ * on limb spans. Multiply() picks schoolbook, Karatsuba (into a single preallocated scratch buffer),
+ * Toom-3 or an exact number theoretic transform by operand size. Large products run on the work
+ * stealing pool: the Karatsuba sub-products and the Toom-3 pointwise products are forked, and the
+ * stages of every transform are split into chunks.
+ * example:
+ * int main ()
+{
+    BigInteger a("3141592653589793238462643383279502884197169399375105820974944592");
+    BigInteger b("2718281828459045235360287471352662497757247093699959574966967627");
+    std::cout << (a * b).ToString() << "\n";
+    return 0;
+}
+ */
+class BigInteger {
+public:
+    typedef uint32_t Limb;
+    static constexpr Limb base = 1000000000;
+    static constexpr int base_digits = 9;
+    /**
+     * @brief crossover points of Multiply(), in limbs of the shorter operand. The defaults can be
+     * replaced by measurements of the running machine with Calibrate().
+     */
+    struct Thresholds {
+        size_t karatsuba = 32;  // schoolbook below
+        size_t toom3 = 256;     // Karatsuba below
+        size_t ntt = 2048;      // Toom-3 below
+        size_t parallel_karatsuba = 128; // sequential Karatsuba below
+        size_t parallel_toom3 = 128; // sequential Toom-3 pointwise products below, in limbs of a part
+    };
+    static Thresholds& Tuning () {
+        static Thresholds thresholds;
+        return thresholds;
+    }
+    // Karatsuba threshold of Tuning(), at least 4 limbs since smaller splits do not shrink the operands
+    static size_t KaratsubaCutoff () {
+        return std::max<size_t>(4, Tuning().karatsuba);
+    }
+
+    bool negative;
+    std::vector<Limb> limbs; // no leading zero limbs, zero has no limb
+
+    BigInteger () : negative(false) {}
+    BigInteger (const std::string& s) : negative(false) {
+        size_t begin = 0;
+        if (!s.empty() && (s[0] == '-' || s[0] == '+')) {
+            this->negative = (s[0] == '-');
+            begin = 1;
+        }
+        // read 9 digits at a time from the least significant end
+        for (long end = s.length(); end > (long)begin; end -= base_digits) {
+            long start = std::max((long)begin, end - base_digits);
+            Limb limb = 0;
+            for (long i = start; i < end; ++i) limb = limb * 10 + (s[i] - '0');
+            this->limbs.emplace_back(limb);
+        }
+        Trim();
+    }
+    bool IsZero () const { return this->limbs.empty(); }
+    // remove leading zero limbs, zero is never negative
+    void Trim () {
+        while (!this->limbs.empty() && this->limbs.back() == 0) this->limbs.pop_back();
+        if (this->limbs.empty()) this->negative = false;
+    }
+    std::string ToString () const {
+        if (IsZero()) return "0";
+        std::string s = this->negative ? "-" : "";
+        s += std::to_string(this->limbs.back());
+        for (long i = (long)this->limbs.size() - 2; i >= 0; --i) {
+            std::string digits = std::to_string(this->limbs[i]);
+            s.append(base_digits - digits.length(), '0');
+            s += digits;
+        }
+        return s;
+    }
+    /**
+     * @brief compare magnitudes of a[0, na) and b[0, nb), both without leading zero limbs
+     *
+     * @return int -1, 0 or 1 for less, equal or greater
+     */
+    static int Compare (const Limb* a, size_t na, const Limb* b, size_t nb) {
+        if (na != nb) return (na < nb) ? -1 : 1;
+        for (size_t i = na; i-- > 0;) {
+            if (a[i] != b[i]) return (a[i] < b[i]) ? -1 : 1;
+        }
+        return 0;
+    }
+    /**
+     * @brief a[0, na) += b[0, nb), requires na >= nb
+     *
+     * @return Limb carry out of the most significant limb
+     */
+    static Limb AddTo (Limb* a, size_t na, const Limb* b, size_t nb) {
+        Limb carry = 0;
+        size_t i = 0;
+        for (; i < nb; ++i) {
+            Limb sum = a[i] + b[i] + carry;
+            carry = (sum >= base);
+            a[i] = carry ? sum - base : sum;
+        }
+        for (; carry && i < na; ++i) {
+            if (++a[i] == base) a[i] = 0;
+            else carry = 0;
+        }
+        return carry;
+    }
+    /**
+     * @brief a[0, na) -= b[0, nb), requires a >= b
+     *
+     */
+    static void SubFrom (Limb* a, size_t na, const Limb* b, size_t nb) {
+        Limb borrow = 0;
+        size_t i = 0;
+        for (; i < nb; ++i) {
+            Limb sub = b[i] + borrow;
+            borrow = (a[i] < sub);
+            a[i] = borrow ? a[i] + base - sub : a[i] - sub;
+        }
+        for (; borrow && i < na; ++i) {
+            if (a[i] == 0) a[i] = base - 1;
+            else {
+                --a[i];
+                borrow = 0;
+            }
+        }
+    }
+    // length of a[0, n) without leading zero limbs
+    static size_t Length (const Limb* a, size_t n) {
+        while (n > 0 && a[n - 1] == 0) --n;
+        return n;
+    }
+    /**
+     * @brief order O(na*nb) multiplication, r[0, na + nb) = a * b
+     *
+     */
+    static void MulSchoolbook (const Limb* a, size_t na, const Limb* b, size_t nb, Limb* r) {
+        std::fill(r, r + na + nb, 0);
+        for (size_t i = 0; i < na; ++i) {
+            uint64_t carry = 0;
+            const uint64_t ai = a[i];
+            if (ai == 0) continue;
+            for (size_t j = 0; j < nb; ++j) {
+                uint64_t cur = r[i + j] + ai * b[j] + carry;
+                r[i + j] = cur % base;
+                carry = cur / base;
+            }
+            r[i + nb] = carry;
+        }
+    }
+    /**
+     * @brief number of scratch limbs needed by MulKaratsuba() for operands of at most n limbs
+     *
+     */
+    static size_t ScratchSize (size_t n) {
+        if (n < KaratsubaCutoff()) return 0;
+        size_t h = n - n/2 + 1;
+        return 4 * h + ScratchSize(h);
+    }
+    /**
+     * @brief order O(n^1.585) multiplication, r[0, na + nb) = a * b.
+     * Every temporary lives in scratch, which holds at least ScratchSize(max(na, nb)) limbs.
+     *
+     */
+    static void MulKaratsuba (const Limb* a, size_t na, const Limb* b, size_t nb, Limb* r, Limb* scratch) {
+        if (na < nb) {
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+        if (nb < KaratsubaCutoff()) {
+            MulSchoolbook(a, na, b, nb, r);
+            return;
+        }
+        if (na >= 2 * nb) {
+            // unbalanced: multiply nb sized chunks of a and accumulate
+            std::fill(r, r + na + nb, 0);
+            Limb* product = scratch;
+            for (size_t i = 0; i < na; i += nb) {
+                size_t chunk = std::min(nb, na - i);
+                MulKaratsuba(a + i, chunk, b, nb, product, scratch + 2 * nb);
+                AddTo(r + i, na + nb - i, product, chunk + nb);
+            }
+            return;
+        }
+        // split at m, so that a = a1 * base^m + a0 and b = b1 * base^m + b0
+        const size_t m = na / 2;
+        const size_t h = na - m;
+        /* z0 = a0 * b0 and z2 = a1 * b1 are written into place */
+        MulKaratsuba(a, m, b, m, r, scratch);
+        MulKaratsuba(a + m, h, b + m, nb - m, r + 2 * m, scratch);
+        /* z1 = (a0 + a1) * (b0 + b1) - z2 - z0 */
+        Limb* sa = scratch;
+        Limb* sb = sa + (h + 1);
+        Limb* z1 = sb + (h + 1);
+        Limb* next = z1 + 2 * (h + 1);
+        std::copy(a + m, a + na, sa);
+        sa[h] = AddTo(sa, h, a, m);
+        size_t lb = std::max(m, nb - m);
+        std::fill(sb, sb + lb + 1, 0);
+        std::copy(b, b + m, sb);
+        sb[lb] = AddTo(sb, lb, b + m, nb - m);
+        size_t la = Length(sa, h + 1);
+        lb = Length(sb, lb + 1);
+        size_t lz = 2 * (h + 1);
+        std::fill(z1, z1 + lz, 0);
+        MulKaratsuba(sa, la, sb, lb, z1, next);
+        SubFrom(z1, lz, r, 2 * m);
+        SubFrom(z1, lz, r + 2 * m, na + nb - 2 * m);
+        AddTo(r + m, na + nb - m, z1, Length(z1, lz));
+    }
+    /**
+     * @brief MulKaratsuba() with the three sub-products of the top recursion levels forked onto 
+     * the thread pool. Every forked task owns its scratch buffer, below depth 0 or operands 
+     * shorter than parallel_karatsuba limbs the recursion is sequential. The result is identical.
+     *
+     * @param depth number of levels still allowed to fork
+     */
+    static void MulKaratsubaParallel (const Limb* a, size_t na, const Limb* b, size_t nb, Limb* r, int depth) {
+        if (na < nb) {
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+        if (depth <= 0 || nb < Tuning().parallel_karatsuba || na >= 2 * nb) {
+            std::vector<Limb> scratch(ScratchSize(na));
+            MulKaratsuba(a, na, b, nb, r, scratch.data());
+            return;
+        }
+        const size_t m = na / 2;
+        const size_t h = na - m;
+        std::vector<Limb> sa(a + m, a + na), sb(std::max(m, nb - m), 0);
+        sa.emplace_back(AddTo(sa.data(), h, a, m));
+        std::copy(b, b + m, sb.begin());
+        sb.emplace_back(AddTo(sb.data(), sb.size(), b + m, nb - m));
+        std::vector<Limb> z1(2 * (h + 1), 0);
+        {
+            TaskGroup group;
+            group.Run([=] { MulKaratsubaParallel(a, m, b, m, r, depth - 1); });
+            group.Run([=] { MulKaratsubaParallel(a + m, h, b + m, nb - m, r + 2 * m, depth - 1); });
+            MulKaratsubaParallel(sa.data(), Length(sa.data(), sa.size()), sb.data(), Length(sb.data(), sb.size()), 
+                                 z1.data(), depth - 1);
+            group.Wait();
+        }
+        SubFrom(z1.data(), z1.size(), r, 2 * m);
+        SubFrom(z1.data(), z1.size(), r + 2 * m, na + nb - 2 * m);
+        AddTo(r + m, na + nb - m, z1.data(), Length(z1.data(), z1.size()));
+    }
+    // fork depth that gives a few tasks per thread of the pool, 0 for a single thread
+    static int ParallelDepth () {
+        if (ThreadPool::Instance().Size() < 2) return 0;
+        int depth = 0;
+        for (int tasks = 1; tasks < 4 * ThreadPool::Instance().Size(); tasks *= 3) ++depth;
+        return depth;
+    }
+    /**
+     * @brief r[0, na + nb) = a * b, dispatched by the size of the shorter operand to 
+     * schoolbook, Karatsuba, Toom-3 or number theoretic transform
+     *
+     */
+    static void Multiply (const Limb* a, size_t na, const Limb* b, size_t nb, Limb* r) {
+        if (na < nb) {
+            std::swap(a, b);
+            std::swap(na, nb);
+        }
+        const Thresholds& t = Tuning();
+        if (nb < KaratsubaCutoff()) {
+            MulSchoolbook(a, na, b, nb, r);
+        } else if (nb < t.toom3) {
+            MulKaratsubaParallel(a, na, b, nb, r, ParallelDepth());
+        } else if (nb >= t.ntt && na + nb <= NTTMaxLength()) {
+            MulNTT(a, na, b, nb, r);
+        } else if (na >= 2 * nb) {
+            // unbalanced: multiply nb sized chunks of a and accumulate
+            std::fill(r, r + na + nb, 0);
+            std::vector<Limb> product(2 * nb);
+            for (size_t i = 0; i < na; i += nb) {
+                size_t chunk = std::min(nb, na - i);
+                Multiply(a + i, chunk, b, nb, product.data());
+                AddTo(r + i, na + nb - i, product.data(), chunk + nb);
+            }
+        } else {
+            MulToom3(a, na, b, nb, r);
+        }
+    }
+    /**
+     * @brief Toom-Cook 3-way multiplication, order O(n^1.465). Operands are split into three parts,
+     * evaluated at 0, 1, -1, -2 and infinity, and interpolated with Bodrato's sequence.
+     * requires na >= nb > 2*na/3 roughly, r[0, na + nb) = a * b
+     *
+     */
+    static void MulToom3 (const Limb* a, size_t na, const Limb* b, size_t nb, Limb* r) {
+        const size_t k = (std::max(na, nb) + 2) / 3;
+        BigInteger a0 = Slice(a, na, 0, k), a1 = Slice(a, na, k, 2 * k), a2 = Slice(a, na, 2 * k, na);
+        BigInteger b0 = Slice(b, nb, 0, k), b1 = Slice(b, nb, k, 2 * k), b2 = Slice(b, nb, 2 * k, nb);
+        // evaluation
+        BigInteger pa = a0 + a2, pb = b0 + b2;
+        BigInteger a_1 = pa + a1, b_1 = pb + b1;            // p(1)
+        BigInteger a_m1 = pa - a1, b_m1 = pb - b1;          // p(-1)
+        BigInteger a_m2 = a_m1 + a2, b_m2 = b_m1 + b2;
+        a_m2.MulSmall(2);
+        b_m2.MulSmall(2);
+        a_m2 -= a0;                                         // p(-2) = 2 * (p(-1) + a2) - a0
+        b_m2 -= b0;
+        // pointwise products, forked when the parts are long enough
+        const BigInteger* x[] = {&a0, &a_1, &a_m1, &a_m2, &a2};
+        const BigInteger* y[] = {&b0, &b_1, &b_m1, &b_m2, &b2};
+        BigInteger product[5];
+        ParallelFor(5, k < Tuning().parallel_toom3 ? 5 : 1, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) product[i] = *x[i] * *y[i];
+        });
+        BigInteger& r0 = product[0];
+        BigInteger& r1 = product[1];
+        BigInteger& rm1 = product[2];
+        BigInteger& rm2 = product[3];
+        BigInteger& rinf = product[4];
+        // interpolation
+        BigInteger c3 = rm2 - r1;
+        c3.DivSmall(3);
+        BigInteger c1 = r1 - rm1;
+        c1.DivSmall(2);
+        BigInteger c2 = rm1 - r0;
+        c3 = c2 - c3;
+        c3.DivSmall(2);
+        BigInteger twice = rinf;
+        twice.MulSmall(2);
+        c3 += twice;
+        c2 += c1;
+        c2 -= rinf;
+        c1 -= c3;
+        // recomposition, every coefficient is non negative now
+        std::fill(r, r + na + nb, 0);
+        const BigInteger* c[] = {&r0, &c1, &c2, &c3, &rinf};
+        for (size_t i = 0; i < 5; ++i) {
+            size_t offset = i * k;
+            if (c[i]->IsZero() || offset >= na + nb) continue;
+            AddTo(r + offset, na + nb - offset, c[i]->limbs.data(), c[i]->limbs.size());
+        }
+    }
+    // longest product supported by MulNTT(), limited by the 2^23 roots of unity of 998244353
+    static size_t NTTMaxLength () { return (size_t)1 << 23; }
+    /**
+     * @brief exact O(n*log(n)) multiplication by number theoretic transform. The convolution of 
+     * limbs is computed modulo three NTT friendly primes and recombined by the Chinese remainder 
+     * theorem, the product of the primes exceeds any coefficient so no rounding error exists.
+     * The three primes run as separate tasks and each transform is split into chunks as well.
+     * requires na + nb <= NTTMaxLength(), r[0, na + nb) = a * b
+     *
+     */
+    static void MulNTT (const Limb* a, size_t na, const Limb* b, size_t nb, Limb* r) {
+        static const uint32_t mod[3] = {998244353, 167772161, 469762049};
+        static const uint32_t root[3] = {3, 3, 3};
+        size_t n = 1;
+        while (n < na + nb) n <<= 1;
+        std::vector<uint32_t> residue[3];
+        // the three primes are independent
+        {
+            TaskGroup group;
+            for (int p = 0; p < 3; ++p) {
+                group.Run([&, p] {
+                    std::vector<uint32_t> fa(n, 0), fb(n, 0);
+                    ParallelFor(na, ntt_grain, [&](size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; ++i) fa[i] = a[i] % mod[p];
+                    });
+                    NTT(fa, false, mod[p], root[p]);
+                    if (a == b && na == nb) fb = fa;
+                    else {
+                        ParallelFor(nb, ntt_grain, [&](size_t begin, size_t end) {
+                            for (size_t i = begin; i < end; ++i) fb[i] = b[i] % mod[p];
+                        });
+                        NTT(fb, false, mod[p], root[p]);
+                    }
+                    ParallelFor(n, ntt_grain, [&](size_t begin, size_t end) {
+                        for (size_t i = begin; i < end; ++i) fa[i] = (uint64_t)fa[i] * fb[i] % mod[p];
+                    });
+                    NTT(fa, true, mod[p], root[p]);
+                    residue[p].swap(fa);
+                });
+            }
+        }
+        // Garner's algorithm: x = x1 + m1 * (x2 + m2 * x3)
+        const uint64_t m1 = mod[0], m2 = mod[1], m3 = mod[2];
+        const uint64_t inv_m1_m2 = PowMod(m1 % m2, m2 - 2, m2);
+        const uint64_t m12_m3 = m1 * m2 % m3;
+        const uint64_t inv_m12_m3 = PowMod(m12_m3, m3 - 2, m3);
+        // every coefficient is below base^3, its three digits are computed in parallel
+        std::vector<Limb> digit[3];
+        for (auto& d:digit) d.resize(na + nb);
+        ParallelFor(na + nb, ntt_grain, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) {
+                uint64_t r1 = residue[0][i], r2 = residue[1][i], r3 = residue[2][i];
+                uint64_t t2 = (r2 + m2 - r1 % m2) % m2 * inv_m1_m2 % m2;
+                uint64_t x12 = r1 + m1 * t2; // < m1 * m2
+                uint64_t t3 = (r3 + m3 - x12 % m3) % m3 * inv_m12_m3 % m3;
+                unsigned __int128 x = (unsigned __int128)m1 * m2 * t3 + x12;
+                uint64_t high = (uint64_t)(x / base); // x < 2^87, so high < 2^58
+                digit[0][i] = (Limb)(x - (unsigned __int128)high * base);
+                digit[1][i] = (Limb)(high % base);
+                digit[2][i] = (Limb)(high / base);
+            }
+        });
+        // the carry stays below 3, a column sums to less than 3 * base + 3
+        uint64_t carry = 0;
+        for (size_t i = 0; i < na + nb; ++i) {
+            carry += digit[0][i];
+            if (i >= 1) carry += digit[1][i - 1];
+            if (i >= 2) carry += digit[2][i - 2];
+            r[i] = (Limb)(carry % base);
+            carry /= base;
+        }
+    }
+    /**
+     * @brief measure the crossover points of Multiply() on the running machine and store them 
+     * in Tuning(). Each crossover is the smallest size where one level of the faster algorithm, 
+     * recursing into the slower one, beats the slower algorithm alone.
+     *
+     * @param verbose print measured times
+     */
+    static void Calibrate (bool verbose = true) {
+        Thresholds& t = Tuning();
+        std::mt19937 gen(2022);
+        auto random_limbs = [&](size_t n) {
+            std::vector<Limb> v(n);
+            for (auto& x:v) x = gen() % base;
+            return v;
+        };
+        // average seconds of one call
+        auto measure = [](auto f) {
+            size_t rounds = 0;
+            auto begin = std::chrono::steady_clock::now();
+            double elapsed = 0;
+            do {
+                f();
+                ++rounds;
+                elapsed = std::chrono::duration<double>(std::chrono::steady_clock::now() - begin).count();
+            } while (elapsed < 0.02);
+            return elapsed / rounds;
+        };
+        const Thresholds saved = t;
+        t.toom3 = t.ntt = SIZE_MAX;
+        // schoolbook against one level of Karatsuba
+        t.karatsuba = saved.karatsuba;
+        for (size_t n = 8; n <= 1024; n *= 2) {
+            auto a = random_limbs(n), b = random_limbs(n);
+            std::vector<Limb> r(2 * n);
+            double school = measure([&]{ MulSchoolbook(a.data(), n, b.data(), n, r.data()); });
+            t.karatsuba = n / 2;
+            std::vector<Limb> scratch(ScratchSize(n));
+            double kara = measure([&]{ MulKaratsuba(a.data(), n, b.data(), n, r.data(), scratch.data()); });
+            t.karatsuba = n;
+            if (verbose) std::cout << "limbs " << n << "\tschoolbook " << school << "s\tkaratsuba " << kara << "s\n";
+            if (kara < school) break;
+        }
+        // Karatsuba against one level of Toom-3
+        for (size_t n = 2 * t.karatsuba; n <= 16384; n *= 2) {
+            auto a = random_limbs(n), b = random_limbs(n);
+            std::vector<Limb> r(2 * n);
+            t.toom3 = SIZE_MAX;
+            double kara = measure([&]{ Multiply(a.data(), n, b.data(), n, r.data()); });
+            double toom = measure([&]{ MulToom3(a.data(), n, b.data(), n, r.data()); });
+            t.toom3 = n;
+            if (verbose) std::cout << "limbs " << n << "\tkaratsuba " << kara << "s\ttoom3 " << toom << "s\n";
+            if (toom < kara) break;
+        }
+        // the others against NTT
+        for (size_t n = 2 * t.toom3; n <= NTTMaxLength() / 2; n *= 2) {
+            auto a = random_limbs(n), b = random_limbs(n);
+            std::vector<Limb> r(2 * n);
+            t.ntt = SIZE_MAX;
+            double other = measure([&]{ Multiply(a.data(), n, b.data(), n, r.data()); });
+            double ntt = measure([&]{ MulNTT(a.data(), n, b.data(), n, r.data()); });
+            t.ntt = n;
+            if (verbose) std::cout << "limbs " << n << "\ttoom3 " << other << "s\tntt " << ntt << "s\n";
+            if (ntt < other) break;
+        }
+        if (verbose) std::cout << "thresholds: karatsuba " << t.karatsuba << ", toom3 " << t.toom3 << ", ntt " << t.ntt << "\n";
+    }
+    // multiply the magnitude by a small factor in place
+    void MulSmall (Limb factor) {
+        uint64_t carry = 0;
+        for (auto& limb:this->limbs) {
+            uint64_t cur = (uint64_t)limb * factor + carry;
+            limb = cur % base;
+            carry = cur / base;
+        }
+        while (carry) {
+            this->limbs.emplace_back(carry % base);
+            carry /= base;
+        }
+        Trim();
+    }
+    // divide the magnitude by a small divisor in place, truncating toward zero
+    void DivSmall (Limb divisor) {
+        uint64_t rem = 0;
+        for (size_t i = this->limbs.size(); i-- > 0;) {
+            uint64_t cur = this->limbs[i] + rem * base;
+            this->limbs[i] = cur / divisor;
+            rem = cur % divisor;
+        }
+        Trim();
+    }
+    /**
+     * @brief in place signed addition
+     *
+     */
+    BigInteger& operator+= (const BigInteger& other) {
+        return AddSigned(other, other.negative);
+    }
+    /**
+     * @brief in place signed subtraction
+     *
+     */
+    BigInteger& operator-= (const BigInteger& other) {
+        return AddSigned(other, !other.negative);
+    }
+    friend BigInteger operator+ (BigInteger a, const BigInteger& b) { return a += b; }
+    friend BigInteger operator- (BigInteger a, const BigInteger& b) { return a -= b; }
+    friend BigInteger operator* (const BigInteger& a, const BigInteger& b) {
+        BigInteger ans;
+        if (a.IsZero() || b.IsZero()) return ans;
+        size_t na = a.limbs.size(), nb = b.limbs.size();
+        ans.limbs.resize(na + nb);
+        Multiply(a.limbs.data(), na, b.limbs.data(), nb, ans.limbs.data());
+        ans.negative = (a.negative != b.negative);
+        ans.Trim();
+        return ans;
+    }
+private:
+    // limbs a[begin, end) as a non negative number
+    static BigInteger Slice (const Limb* a, size_t n, size_t begin, size_t end) {
+        BigInteger x;
+        if (begin < n) x.limbs.assign(a + begin, a + std::min(end, n));
+        x.Trim();
+        return x;
+    }
+    static uint64_t PowMod (uint64_t b, uint64_t e, uint64_t mod) {
+        uint64_t ans = 1;
+        b %= mod;
+        for (; e; e >>= 1, b = b * b % mod) {
+            if (e & 1) ans = ans * b % mod;
+        }
+        return ans;
+    }
+    // items per task of the chunked loops in MulNTT() and NTT()
+    static constexpr size_t ntt_grain = 1 << 14;
+    /**
+     * @brief run f(begin, end) over chunks of [0, n) holding at least grain items, a few chunks per 
+     * thread of the pool. Runs f(0, n) on the calling thread when there is a single chunk.
+     *
+     */
+    template <class F>
+    static void ParallelFor (size_t n, size_t grain, F f) {
+        const size_t workers = ThreadPool::Instance().Size();
+        const size_t chunks = std::min(4 * workers, n / std::max<size_t>(grain, 1));
+        if (workers < 2 || chunks < 2) {
+            f(0, n);
+            return;
+        }
+        const size_t step = (n + chunks - 1) / chunks;
+        TaskGroup group;
+        for (size_t begin = step; begin < n; begin += step) {
+            group.Run([=] { f(begin, std::min(n, begin + step)); });
+        }
+        f(0, step);
+        group.Wait();
+    }
+    // in place iterative radix-2 transform, length of a is a power of 2
+    static void NTT (std::vector<uint32_t>& a, bool invert, uint32_t mod, uint32_t g) {
+        const size_t n = a.size();
+        // scalars and pointers are captured by value, stores into the array may not alias them
+        uint32_t* data = a.data();
+        // bit reversal permutation, a pair is swapped by the chunk holding its smaller index
+        ParallelFor(n, ntt_grain, [=](size_t begin, size_t end) {
+            size_t j = 0;
+            for (size_t bit = 1, rev = n >> 1; bit < n; bit <<= 1, rev >>= 1) {
+                if (begin & bit) j |= rev;
+            }
+            for (size_t i = begin; i < end; ++i) {
+                if (i < j) std::swap(data[i], data[j]);
+                size_t bit = n >> 1;
+                for (; j & bit; bit >>= 1) j ^= bit;
+                j ^= bit;
+            }
+        });
+        std::vector<uint32_t> twiddle(n / 2);
+        uint32_t* w = twiddle.data();
+        for (size_t len = 2; len <= n; len <<= 1) {
+            uint64_t wlen = PowMod(g, (mod - 1) / len, mod);
+            if (invert) wlen = PowMod(wlen, mod - 2, mod);
+            const size_t half = len / 2;
+            ParallelFor(half, ntt_grain, [=](size_t begin, size_t end) {
+                w[begin] = PowMod(wlen, begin, mod);
+                for (size_t i = begin + 1; i < end; ++i) w[i] = (uint64_t)w[i - 1] * wlen % mod;
+            });
+            // butterfly t is pair j = t % half of block t / half
+            ParallelFor(n / 2, ntt_grain, [=](size_t begin, size_t end) {
+                uint32_t* x = data + begin / half * len;
+                size_t j = begin % half;
+                for (size_t t = begin; t < end; x += len, j = 0) {
+                    uint32_t* y = x + half;
+                    const size_t stop = std::min(half, j + end - t);
+                    t += stop - j;
+                    for (; j < stop; ++j) {
+                        uint32_t u = x[j];
+                        uint32_t v = (uint64_t)y[j] * w[j] % mod;
+                        x[j] = (u + v >= mod) ? u + v - mod : u + v;
+                        y[j] = (u >= v) ? u - v : u + mod - v;
+                    }
+                }
+            });
+        }
+        if (invert) {
+            const uint64_t inv_n = PowMod(n, mod - 2, mod);
+            ParallelFor(n, ntt_grain, [=](size_t begin, size_t end) {
+                for (size_t i = begin; i < end; ++i) data[i] = data[i] * inv_n % mod;
+            });
+        }
+    }
+    // add other with the given sign
+    BigInteger& AddSigned (const BigInteger& other, bool other_negative) {
+        if (other.IsZero()) return *this;
+        if (this->negative == other_negative) {
+            if (this->limbs.size() < other.limbs.size()) this->limbs.resize(other.limbs.size(), 0);
+            Limb carry = AddTo(this->limbs.data(), this->limbs.size(), other.limbs.data(), other.limbs.size());
+            if (carry) this->limbs.emplace_back(carry);
+            return *this;
+        }
+        int cmp = Compare(this->limbs.data(), this->limbs.size(), other.limbs.data(), other.limbs.size());
+        if (cmp >= 0) {
+            SubFrom(this->limbs.data(), this->limbs.size(), other.limbs.data(), other.limbs.size());
+        } else {
+            // |other| - |this|, taking the sign of other
+            std::vector<Limb> diff(other.limbs);
+            SubFrom(diff.data(), diff.size(), this->limbs.data(), this->limbs.size());
+            this->limbs.swap(diff);
+            this->negative = other_negative;
+        }
+        Trim();
+        return *this;
+    }
+};
+# endif /* BIG_INTEGER_H_ */
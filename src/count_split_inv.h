@@ -1,7 +1,13 @@
 # ifndef SPLIT_INV_H_
 # define SPLIT_INV_H_
 # include <vector>
+# include <algorithm>
+# include <cmath>
+# include "thread_pool.h"
 class SplitInv {    
+private:
+    const long run = 32; // length of runs sorted by insertion sort before merging
+    std::vector<int> buffer; // ping-pong buffer of CountInversions(), reused between calls
 public:
     SplitInv () {}
     /**
@@ -54,6 +60,319 @@ public:
         std::swap_ranges(v.begin() + l, v.begin() + r + 1, temp.begin());
         return ans;
     }
-    
+    /**
+     * @brief insertion sort of [l, r), each shift removes exactly one inversion
+     * 
+     * @param a array
+     * @param l first index
+     * @param r past the last index
+     * @return long counted inversions
+     */
+    long InsertionCount (int* a, long l, long r) {
+        long ans = 0;
+        for (long i = l + 1; i < r; ++i) {
+            int key = a[i];
+            long j = i;
+            while (j > l && key < a[j - 1]) {
+                a[j] = a[j - 1];
+                --j;
+            }
+            ans += i - j;
+            a[j] = key;
+        }
+        return ans;
+    }
+    /**
+     * @brief branch free merge of sorted src[l, m) and src[m, r) into dst[l, r), 
+     * taking an element from the right half counts the remaining elements of the left half
+     * 
+     * @return long counted inversions
+     */
+    long MergeCount (const int* src, long l, long m, long r, int* dst) {
+        long i = l, j = m, k = l;
+        long ans = 0;
+        if (m == r || src[m - 1] <= src[m]) {
+            // already in order
+            std::copy(src + l, src + r, dst + l);
+            return 0;
+        }
+        while (i < m && j < r) {
+            int x = src[i];
+            int y = src[j];
+            bool right = y < x;
+            dst[k++] = right ? y : x;
+            ans += (m - i) & -(long)right;
+            i += !right;
+            j += right;
+        }
+        std::copy(src + i, src + m, dst + k);
+        std::copy(src + j, src + r, dst + k + (m - i));
+        return ans;
+    }
+    /**
+     * @brief bottom up merge of a[0, n) counting inversions, passes alternate between a and tmp
+     * 
+     * @param a array
+     * @param tmp buffer of n elements
+     * @param n array size
+     * @param sorted updated to a or tmp, whichever holds the sorted result
+     * @return long counted inversions
+     */
+    long BottomUp (int* a, int* tmp, long n, int*& sorted) {
+        long ans = 0;
+        for (long l = 0; l < n; l += this->run) ans += InsertionCount(a, l, std::min(n, l + this->run));
+        int* src = a;
+        int* dst = tmp;
+        for (long width = this->run; width < n; width *= 2) {
+            for (long l = 0; l < n; l += 2 * width) {
+                long m = std::min(n, l + width);
+                long r = std::min(n, l + 2 * width);
+                ans += MergeCount(src, l, m, r, dst);
+            }
+            std::swap(src, dst);
+        }
+        sorted = src;
+        return ans;
+    }
+    /**
+     * @brief bottom up merge sort counting inversions, duplicates are not counted as inversions.
+     * Runs of 32 elements are sorted by insertion sort, then merged pass by pass between v and 
+     * a single buffer allocated once, so no allocation happens during merging.
+     * 
+     * @param v vector, sorted after counting
+     * @return long counted inversions
+     */
+    long CountInversions (std::vector<int>& v) {
+        const long n = v.size();
+        this->buffer.resize(n);
+        int* sorted;
+        long ans = BottomUp(v.data(), this->buffer.data(), n, sorted);
+        // the sorted result ends in buffer after an odd number of passes
+        if (sorted != v.data()) v.swap(this->buffer);
+        return ans;
+    }
+    /**
+     * @brief merge path: number of elements taken from sorted a[0, na) among the first k outputs 
+     * of merging it with sorted b[0, nb), ties taken from a first as in MergeCount()
+     * 
+     * @return long co-rank of k in a
+     */
+    long CoRank (const int* a, long na, const int* b, long nb, long k) {
+        long lo = std::max(0L, k - nb);
+        long hi = std::min(k, na);
+        while (lo < hi) {
+            long i = lo + (hi - lo)/2;
+            // b[k-i-1] should come after a[i], otherwise more elements of a are needed
+            if (!(b[k - i - 1] < a[i])) lo = i + 1;
+            else hi = i;
+        }
+        return lo;
+    }
+    /**
+     * @brief merge src[i, m) and src[j, r) into dst from index k until dst index k_end, 
+     * counting inversions against the whole left half ending at m
+     * 
+     * @return long counted inversions
+     */
+    long MergeSegment (const int* src, long i, long m, long j, long r, int* dst, long k, long k_end) {
+        long ans = 0;
+        while (k < k_end && i < m && j < r) {
+            int x = src[i];
+            int y = src[j];
+            bool right = y < x;
+            dst[k++] = right ? y : x;
+            ans += (m - i) & -(long)right;
+            i += !right;
+            j += right;
+        }
+        while (k < k_end && i < m) dst[k++] = src[i++];
+        while (k < k_end && j < r) dst[k++] = src[j++];
+        return ans;
+    }
+    /**
+     * @brief multi-threaded inversion counter, the halves are counted in parallel down to 
+     * parallel_cutoff elements where BottomUp() takes over, and each merge above the cutoff is 
+     * split by merge path into independent segments merged in parallel.
+     * 
+     * @param v vector, sorted after counting
+     * @return long counted inversions
+     */
+    long ParallelCountInversions (std::vector<int>& v) {
+        const long n = v.size();
+        if (ThreadPool::Instance().Size() < 2 || n <= this->parallel_cutoff) return CountInversions(v);
+        this->buffer.resize(n);
+        return ParallelRec(v.data(), this->buffer.data(), 0, n);
+    }
+private:
+    const long parallel_cutoff = 1 << 16; // ranges no larger than this are counted by a single thread
+    // count a[l, r) in parallel, sorted result is left in a, tmp is used as buffer
+    long ParallelRec (int* a, int* tmp, long l, long r) {
+        if (r - l <= this->parallel_cutoff) {
+            int* sorted;
+            SplitInv local;
+            long ans = local.BottomUp(a + l, tmp + l, r - l, sorted);
+            if (sorted != a + l) std::copy(sorted, sorted + (r - l), a + l);
+            return ans;
+        }
+        long m = l + (r - l)/2;
+        long left = 0, right = 0;
+        {
+            TaskGroup group;
+            group.Run([&] { left = ParallelRec(a, tmp, l, m); });
+            right = ParallelRec(a, tmp, m, r);
+            group.Wait();
+        }
+        // split the merge into segments of equal output size
+        const long segments = std::min((r - l) / this->parallel_cutoff + 1, 4L * (ThreadPool::Instance().Size() + 1));
+        std::vector<long> count(segments, 0);
+        {
+            TaskGroup group;
+            for (long s = 0; s < segments; ++s) {
+                group.Run([&, s] {
+                    long k = (r - l) * s / segments;
+                    long k_end = (r - l) * (s + 1) / segments;
+                    long i = CoRank(a + l, m - l, a + m, r - m, k);
+                    count[s] = MergeSegment(a, l + i, m, m + k - i, r, tmp, l + k, l + k_end);
+                });
+            }
+        }
+        {
+            TaskGroup group;
+            for (long s = 0; s < segments; ++s) {
+                group.Run([&, s] {
+                    long k = (r - l) * s / segments;
+                    long k_end = (r - l) * (s + 1) / segments;
+                    std::copy(tmp + l + k, tmp + l + k_end, a + l + k);
+                });
+            }
+        }
+        long ans = left + right;
+        for (auto c:count) ans += c;
+        return ans;
+    }
+};
+/**
+ * @brief inversion counts of windows and arbitrary subranges of a fixed array. Values are 
+ * compressed to ranks in O(n*log(n)) once, then counts are maintained by a Fenwick tree 
+ * while the window moves, without sorting again.
+ * example:
+ * int main ()
+{
+    std::vector<int> v = {3, 1, 4, 1, 5, 9, 2, 6};
+    RangeInversions test(v);
+    print(test.SlidingWindow(4));
+    std::vector<std::pair<long, long>> ranges = {{0, 8}, {2, 7}};
+    print(test.Query(ranges));
+    return 0;
+}
+ */
+class RangeInversions {
+private:
+    std::vector<int> rank; // compressed value of each element, from 1
+    std::vector<long> tree; // Fenwick tree counting ranks inside the current window
+    long window; // number of elements inside the window
+    void Add (int i, long delta) {
+        for (; i < (int)this->tree.size(); i += i & -i) this->tree[i] += delta;
+    }
+    // number of elements in the window with rank no larger than i
+    long Prefix (int i) {
+        long sum = 0;
+        for (; i > 0; i -= i & -i) sum += this->tree[i];
+        return sum;
+    }
+    long Less (int i) { return Prefix(i - 1); }
+    long Greater (int i) { return this->window - Prefix(i); }
+    void Reset () {
+        std::fill(this->tree.begin(), this->tree.end(), 0);
+        this->window = 0;
+    }
+public:
+    RangeInversions (const std::vector<int>& v) : window(0) {
+        std::vector<int> values(v);
+        std::sort(values.begin(), values.end());
+        values.erase(std::unique(values.begin(), values.end()), values.end());
+        this->rank.reserve(v.size());
+        for (auto x:v) this->rank.emplace_back(std::lower_bound(values.begin(), values.end(), x) - values.begin() + 1);
+        this->tree.assign(values.size() + 1, 0);
+    }
+    /**
+     * @brief inversion counts of every window of width w, in O(n*log(n))
+     * 
+     * @param w window width
+     * @return std::vector<long> count of window [i, i + w) at index i
+     */
+    std::vector<long> SlidingWindow (long w) {
+        const long n = this->rank.size();
+        std::vector<long> ans;
+        if (w <= 0 || w > n) return ans;
+        Reset();
+        long count = 0;
+        for (long i = 0; i < w; ++i) {
+            count += Greater(this->rank[i]);
+            Add(this->rank[i], 1);
+            ++this->window;
+        }
+        ans.emplace_back(count);
+        for (long i = w; i < n; ++i) {
+            // the leaving element was before all the others in the window
+            Add(this->rank[i - w], -1);
+            --this->window;
+            count -= Less(this->rank[i - w]);
+            // the entering element is after all the others
+            count += Greater(this->rank[i]);
+            Add(this->rank[i], 1);
+            ++this->window;
+            ans.emplace_back(count);
+        }
+        return ans;
+    }
+    /**
+     * @brief inversion counts of arbitrary subranges answered offline with Mo's ordering,
+     * O((n*sqrt(q) + q)*log(n)) for q queries
+     * 
+     * @param ranges half open index ranges [first, second)
+     * @return std::vector<long> count of each range in given order
+     */
+    std::vector<long> Query (const std::vector<std::pair<long, long>>& ranges) {
+        const long q = ranges.size();
+        std::vector<long> ans(q, 0);
+        if (q == 0) return ans;
+        const long block = std::max(1L, (long)(this->rank.size() / std::sqrt((double)q)));
+        std::vector<long> order(q);
+        for (long i = 0; i < q; ++i) order[i] = i;
+        std::sort(order.begin(), order.end(), [&](long a, long b) {
+            long ba = ranges[a].first / block, bb = ranges[b].first / block;
+            if (ba != bb) return ba < bb;
+            // alternate direction of the right end between blocks
+            return (ba & 1) ? ranges[a].second > ranges[b].second : ranges[a].second < ranges[b].second;
+        });
+        Reset();
+        long l = 0, r = 0, count = 0;
+        for (auto idx:order) {
+            long ql = ranges[idx].first, qr = ranges[idx].second;
+            while (r < qr) {
+                count += Greater(this->rank[r]);
+                Add(this->rank[r++], 1);
+                ++this->window;
+            }
+            while (l > ql) {
+                count += Less(this->rank[--l]);
+                Add(this->rank[l], 1);
+                ++this->window;
+            }
+            while (r > qr) {
+                Add(this->rank[--r], -1);
+                --this->window;
+                count -= Greater(this->rank[r]);
+            }
+            while (l < ql) {
+                Add(this->rank[l], -1);
+                --this->window;
+                count -= Less(this->rank[l++]);
+            }
+            ans[idx] = count;
+        }
+        return ans;
+    }
 };
 # endif /* SPLIT_INV_H_ */
\ No newline at end of file
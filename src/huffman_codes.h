@@ -1,16 +1,292 @@
 # ifndef HUFFMAN_CODES_H_
 # define HUFFMAN_CODES_H_
 # include "util.h"
-# include <queue>
 # include <algorithm>
+# include <cstdint>
+# include <cstring>
+# include <random>
+# include <chrono>
+# include <cmath>
+/**
+ * @brief node of the Huffman tree, children are indices into the node pool, -1 for a leaf
+ *
+ */
 struct TreeNode {
-    int weight;
-    int symbol;
-    TreeNode* left;
-    TreeNode* right;
-    TreeNode() : weight(0), symbol(0), left(nullptr), right(nullptr) {}
-    TreeNode(int w, int i) : weight(w), symbol(i), left(nullptr), right(nullptr) {}
-    TreeNode(int w, int i, TreeNode *left, TreeNode *right) : weight(w), symbol(i), left(left), right(right) {}
+    long weight;
+    int32_t symbol;
+    int32_t left;
+    int32_t right;
+    TreeNode() : weight(0), symbol(0), left(-1), right(-1) {}
+    TreeNode(long w, int32_t i) : weight(w), symbol(i), left(-1), right(-1) {}
+    TreeNode(long w, int32_t i, int32_t left, int32_t right) : weight(w), symbol(i), left(left), right(right) {}
+};
+/**
+ * @brief canonical Huffman code built from code lengths only, with a bit packed encoder and a
+ * table driven decoder. Codes of the same length are consecutive numbers in symbol order, so the
+ * code table is fully defined by the lengths. Codes are written least significant bit first into
+ * 64-bit words, each code bit reversed, so the decoder indexes its table with the low bits of the
+ * stream. The first level table holds every 11-bit prefix and decodes up to 3 short codes per probe,
+ * longer codes continue in a second level table sized by the longest code under the prefix.
+ * The data is coded as 4 independent streams, the decoder interleaves them so that their table
+ * lookups overlap instead of waiting on each other. Longer codes are shortened to 32 bits by
+ * LimitLengths() before the codes are assigned.
+ *
+ */
+class CanonicalHuffman {
+private:
+    static const int table_bits = 11;
+    static const int streams = 4;
+    static const int max_length = 32;
+    struct Entry {
+        uint32_t symbol[3]; // decoded symbols, or the offset of the second level table
+        uint8_t count; // symbols decoded by this entry, 0 for a second level table
+        uint8_t bits; // bits consumed, or the index bits of the second level table
+        uint16_t spare;
+    };
+    struct Leaf {
+        uint32_t symbol;
+        uint32_t bits;
+    };
+    std::vector<uint32_t> code; // canonical code, most significant bit first
+    std::vector<uint32_t> reversed; // code as written to the stream
+    std::vector<uint8_t> length;
+    std::vector<Entry> table;
+    std::vector<Leaf> second;
+    static uint32_t Reverse (uint32_t x, int len) {
+        uint32_t r = 0;
+        for (int i = 0; i < len; ++i, x >>= 1) r = (r << 1) | (x & 1);
+        return r;
+    }
+    // 64 bits of the stream from bit position pos, at least 57 of them valid
+    static uint64_t Peek (const uint8_t* bytes, uint64_t pos) {
+        uint64_t window;
+        std::memcpy(&window, bytes + (pos >> 3), sizeof(window));
+        return window >> (pos & 7);
+    }
+    // write the codes of [first, last) at out, the bits above the last code stay zero
+    void EncodeStream (const uint32_t* first, const uint32_t* last, uint8_t* out) {
+        uint64_t buffer = 0;
+        int used = 0;
+        for (; first != last; ++first) {
+            buffer |= (uint64_t)this->reversed[*first] << used;
+            used += this->length[*first];
+            // flush the whole bytes, at most 7 bits stay in the buffer
+            std::memcpy(out, &buffer, sizeof(buffer));
+            out += used >> 3;
+            buffer >>= used & ~7;
+            used &= 7;
+        }
+        std::memcpy(out, &buffer, sizeof(buffer));
+    }
+    // one table probe at bit position pos, write the symbols to out and return number of bits
+    static int DecodeStep (const Entry* table, const Leaf* second, const uint8_t* bytes, uint64_t pos, uint32_t* out, int& count) {
+        const uint64_t window = Peek(bytes, pos);
+        const Entry& e = table[window & ((1u << table_bits) - 1)];
+        if (e.count) {
+            out[0] = e.symbol[0];
+            out[1] = e.symbol[1];
+            out[2] = e.symbol[2];
+            count = e.count;
+            return e.bits;
+        }
+        const Leaf& leaf = second[e.symbol[0] + ((window >> table_bits) & ((1u << e.bits) - 1))];
+        out[0] = leaf.symbol;
+        count = 1;
+        return leaf.bits;
+    }
+public:
+    /**
+     * @brief clamp code lengths to limit and restore the Kraft inequality, sum of 2^-length <= 1,
+     * by lengthening the longest codes shorter than limit one bit at a time. Every step takes away
+     * the least code space possible, and the symbols keep the order of their original lengths.
+     * requires the number of used symbols <= 2^limit
+     *
+     * @param lengths code length of each symbol, 0 for a symbol not used
+     */
+    static void LimitLengths (std::vector<int>& lengths, int limit) {
+        std::vector<uint32_t> order;
+        for (uint32_t s = 0; s < lengths.size(); ++s) {
+            if (lengths[s] > 0) order.emplace_back(s);
+        }
+        if (order.empty()) return;
+        std::sort(order.begin(), order.end(), [&lengths](uint32_t a, uint32_t b) {
+            return lengths[a] != lengths[b] ? lengths[a] < lengths[b] : a < b;
+        });
+        if (lengths[order.back()] <= limit) return;
+        // code space in units of 2^-limit
+        std::vector<uint64_t> count(limit + 1, 0);
+        uint64_t total = 0;
+        for (uint32_t s:order) {
+            const int len = std::min(lengths[s], limit);
+            ++count[len];
+            total += 1ULL << (limit - len);
+        }
+        int len = limit - 1;
+        while (total > (1ULL << limit)) {
+            while (len > 0 && count[len] == 0) --len;
+            if (len == 0) break;
+            --count[len];
+            ++count[len + 1];
+            total -= 1ULL << (limit - len - 1);
+            // the moved code may be lengthened again
+            if (len + 1 < limit) ++len;
+        }
+        // hand out the lengths in order
+        size_t i = 0;
+        for (int l = 1; l <= limit; ++l) {
+            for (uint64_t c = 0; c < count[l]; ++c) lengths[order[i++]] = l;
+        }
+    }
+    /**
+     * @brief Construct a new Canonical Huffman object
+     *
+     * @param code_lengths code length of each symbol, 0 for a symbol not used. The lengths must
+     * satisfy the Kraft inequality, those over 32 bits are limited by LimitLengths().
+     */
+    CanonicalHuffman (const std::vector<int>& code_lengths) : code(code_lengths.size(), 0), reversed(code_lengths.size(), 0), length(code_lengths.size(), 0) {
+        std::vector<int> lengths = code_lengths;
+        LimitLengths(lengths, max_length);
+        std::vector<uint32_t> order;
+        for (uint32_t s = 0; s < lengths.size(); ++s) {
+            if (lengths[s] > 0) order.emplace_back(s);
+            this->length[s] = lengths[s];
+        }
+        std::sort(order.begin(), order.end(), [&lengths](uint32_t a, uint32_t b) {
+            return lengths[a] != lengths[b] ? lengths[a] < lengths[b] : a < b;
+        });
+        // consecutive codes within a length, shifted left when the length grows
+        uint32_t next = 0;
+        int prev_len = order.empty() ? 0 : lengths[order[0]];
+        for (uint32_t s:order) {
+            next <<= lengths[s] - prev_len;
+            prev_len = lengths[s];
+            this->code[s] = next++;
+            this->reversed[s] = Reverse(this->code[s], lengths[s]);
+        }
+        // single symbol per prefix first
+        const uint32_t size = 1u << table_bits;
+        this->table.assign(size, Entry());
+        std::vector<int> longest(size, 0); // longest code under a prefix that does not fit
+        for (uint32_t s:order) {
+            const int len = lengths[s];
+            if (len <= table_bits) {
+                for (uint32_t fill = 0; fill < (1u << (table_bits - len)); ++fill) {
+                    Entry& e = this->table[this->reversed[s] | (fill << len)];
+                    e.symbol[0] = s;
+                    e.count = 1;
+                    e.bits = len;
+                }
+            } else {
+                uint32_t prefix = this->reversed[s] & (size - 1);
+                longest[prefix] = std::max(longest[prefix], len);
+            }
+        }
+        for (uint32_t prefix = 0; prefix < size; ++prefix) {
+            if (!longest[prefix]) continue;
+            Entry& e = this->table[prefix];
+            e.count = 0;
+            e.bits = longest[prefix] - table_bits;
+            e.symbol[0] = this->second.size();
+            this->second.resize(this->second.size() + (1u << e.bits), Leaf{0, 0});
+        }
+        for (uint32_t s:order) {
+            const int len = lengths[s];
+            if (len <= table_bits) continue;
+            const Entry& e = this->table[this->reversed[s] & (size - 1)];
+            const uint32_t high = this->reversed[s] >> table_bits;
+            for (uint32_t fill = 0; fill < (1u << (e.bits - (len - table_bits))); ++fill) {
+                this->second[e.symbol[0] + (high | (fill << (len - table_bits)))] = Leaf{s, (uint32_t)len};
+            }
+        }
+        // append the following short codes while they fit in the prefix
+        std::vector<Entry> single = this->table;
+        for (uint32_t prefix = 0; prefix < size; ++prefix) {
+            Entry& e = this->table[prefix];
+            if (e.count == 0) continue;
+            while (e.count < 3) {
+                const Entry& follow = single[prefix >> e.bits];
+                if (follow.count == 0 || e.bits + follow.bits > table_bits) break;
+                e.symbol[e.count++] = follow.symbol[0];
+                e.bits += follow.bits;
+            }
+        }
+    }
+    uint32_t Code (uint32_t symbol) { return this->code[symbol]; }
+    int Length (uint32_t symbol) { return this->length[symbol]; }
+    /**
+     * @brief pack the codes of data into 64-bit words. The data is split in 4 parts of equal size,
+     * each part is a stream followed by one zero word so that the decoder can always read a whole
+     * word ahead, the first 4 words are the offsets of the streams.
+     *
+     * @return uint64_t number of code bits written
+     */
+    uint64_t Encode (const std::vector<uint32_t>& data, std::vector<uint64_t>& words) {
+        const size_t part = (data.size() + streams - 1) / streams;
+        size_t first[streams + 1], offset[streams], size = streams;
+        uint64_t total = 0;
+        for (int k = 0; k <= streams; ++k) first[k] = std::min(data.size(), k * part);
+        // sizes of the streams from the code lengths
+        for (int k = 0; k < streams; ++k) {
+            uint64_t bits = 0;
+            for (size_t i = first[k]; i < first[k + 1]; ++i) bits += this->length[data[i]];
+            offset[k] = size;
+            size += (bits + 63) / 64 + 1;
+            total += bits;
+        }
+        words.assign(size, 0);
+        for (int k = 0; k < streams; ++k) {
+            words[k] = offset[k];
+            EncodeStream(data.data() + first[k], data.data() + first[k + 1], reinterpret_cast<uint8_t*>(words.data() + offset[k]));
+        }
+        return total;
+    }
+    /**
+     * @brief decode count symbols from words written by Encode()
+     *
+     */
+    void Decode (const std::vector<uint64_t>& words, size_t count, std::vector<uint32_t>& data) {
+        // room for the symbols an entry decodes past the end
+        data.resize(count + 3);
+        const size_t part = (count + streams - 1) / streams;
+        const Entry* table = this->table.data();
+        const Leaf* second = this->second.data();
+        const uint8_t* bytes[streams];
+        uint64_t pos[streams];
+        uint32_t* out[streams];
+        uint32_t* end[streams];
+        for (int k = 0; k < streams; ++k) {
+            bytes[k] = reinterpret_cast<const uint8_t*>(words.data() + words[k]);
+            pos[k] = 0;
+            out[k] = data.data() + std::min(count, k * part);
+            end[k] = data.data() + std::min(count, k * part + part);
+        }
+        // the streams in registers while none of them can run into the next part
+        int n0, n1, n2, n3;
+        uint64_t p0 = 0, p1 = 0, p2 = 0, p3 = 0;
+        uint32_t *o0 = out[0], *o1 = out[1], *o2 = out[2], *o3 = out[3];
+        while (o0 + 3 <= end[0] && o1 + 3 <= end[1] && o2 + 3 <= end[2] && o3 + 3 <= end[3]) {
+            p0 += DecodeStep(table, second, bytes[0], p0, o0, n0);
+            p1 += DecodeStep(table, second, bytes[1], p1, o1, n1);
+            p2 += DecodeStep(table, second, bytes[2], p2, o2, n2);
+            p3 += DecodeStep(table, second, bytes[3], p3, o3, n3);
+            o0 += n0;
+            o1 += n1;
+            o2 += n2;
+            o3 += n3;
+        }
+        pos[0] = p0, pos[1] = p1, pos[2] = p2, pos[3] = p3;
+        out[0] = o0, out[1] = o1, out[2] = o2, out[3] = o3;
+        // the rest of each stream, copied so that symbols past the end keep the next part intact
+        uint32_t symbols[3];
+        int n;
+        for (int k = 0; k < streams; ++k) {
+            while (out[k] < end[k]) {
+                pos[k] += DecodeStep(table, second, bytes[k], pos[k], symbols, n);
+                for (int i = 0; i < n && out[k] < end[k]; ++i) *out[k]++ = symbols[i];
+            }
+        }
+        data.resize(count);
+    }
 };
 /**
  * @brief Huffman code algorithm
@@ -21,22 +297,25 @@ struct TreeNode {
     if(!ReadData("../data/_eed1bd08e2fa58bbe94b24c06a20dcdb_huffman.txt", true, test))
         std::cout << "fail opening file";
     test.Run();
+    test.Benchmark();
     return 0;
 }
- * 
+ *
  */
 class HuffmanCodes {
 private:
     int vertex_num;
-    std::vector<TreeNode*> symbols;
-    int idx; // for denoting the symbol from data
+    std::vector<long> weights; // weights[i] is the weight of symbol i + 1
+    // all nodes of the tree in one pool: the leaves sorted by weight, then the internal nodes in
+    // the order they are merged, so the internal nodes are sorted by weight as well
+    std::vector<TreeNode> pool;
 public:
-    HuffmanCodes ():idx(1) {}
+    HuffmanCodes () : vertex_num(0) {}
     void ProcessHeader(std::string& line) {
         this->vertex_num = std::stoi(line);
     }
     /**
-     * @brief 
+     * @brief
 
         This file describes an instance of the problem. It has the following format:
 
@@ -48,80 +327,95 @@ public:
 
         ...
 
-        For example, the third line of the file is "6852892," indicating that the weight of the second symbol of the alphabet is 6852892. 
-     * 
-     * @param line 
+        For example, the third line of the file is "6852892," indicating that the weight of the second symbol of the alphabet is 6852892.
+     *
+     * @param line
      */
     void ProcessLine(std::string& line) {
-        int weight = std::stoi(line);
-        this->symbols.emplace_back(new TreeNode(weight, idx));
-        ++idx;
+        this->weights.emplace_back(std::stol(line));
     }
-    void PrintNodes(std::vector<TreeNode*>& v) {
+    void PrintNodes(std::vector<TreeNode>& v) {
         for (auto& i:v) {
-            std::cout << i->symbol << ": " << i->weight << "\n";
+            std::cout << i.symbol << ": " << i.weight << "\n";
         }
     }
     /**
-     * @brief extract top element from queue
-     * 
-     * @param q 
-     * @return TreeNode* 
+     * @brief build the tree in the node pool by the two queue merge. The first queue is the sorted
+     * leaves and the second queue is the internal nodes, both are ranges of the pool walked by a
+     * cursor, so the merge is O(n) after sorting.
+     *
+     * @return int index of the root in the pool, -1 if there is no symbol
      */
-    TreeNode* Pop(std::queue<TreeNode*>& q) {
-        auto node = q.front();
-        q.pop();
-        return node;
+    int BuildHuffmanTree() {
+        const int n = this->weights.size();
+        Release();
+        if (n == 0) return -1;
+        this->pool.reserve(2 * n - 1);
+        for (int i = 0; i < n; ++i) this->pool.emplace_back(this->weights[i], i + 1);
+        // sort the leaves with its weight in non decreasing order
+        std::sort(this->pool.begin(), this->pool.end(), [](const TreeNode& a, const TreeNode& b){ return (a.weight < b.weight);});
+        int leaf = 0, internal = n;
+        auto get_min = [&]() {
+            if (internal == (int)this->pool.size()) return leaf++;
+            if (leaf == n) return internal++;
+            if (this->pool[leaf].weight < this->pool[internal].weight) return leaf++;
+            else return internal++;
+        };
+        for (int merged = 1; merged < n; ++merged) {
+            int left = get_min();
+            int right = get_min();
+            this->pool.emplace_back(this->pool[left].weight + this->pool[right].weight, 0, left, right);
+        }
+        return this->pool.size() - 1;
+    }
+    // free the node pool of the last run
+    void Release() {
+        std::vector<TreeNode>().swap(this->pool);
     }
     /**
-     * @brief Get the Min object from two queue
-     * 
-     * @param l 
-     * @param r 
-     * @return TreeNode* 
+     * @brief code length of every symbol. A parent is always merged after its children, so one
+     * pass over the pool from the root down gives every depth without recursion.
+     *
+     * @param root index returned by BuildHuffmanTree()
+     * @return std::vector<int> length of symbol i at index i, index 0 is unused
      */
-    TreeNode* GetMin(std::queue<TreeNode*>& l, std::queue<TreeNode*>& r) {
-        if (r.empty()) return Pop(l);
-        if (l.empty()) return Pop(r);
-        if (l.front()->weight < r.front()->weight) return Pop(l);
-        else return Pop(r);
-    }
-    TreeNode* BuildHuffmanTree(std::vector<TreeNode*>& sorted) {
-        std::queue<TreeNode*> l,r;
-        // begin with all sorted nodes in left queue, and empty right queue
-        for (auto& node:sorted) l.emplace(node);
-        // build tree
-        int n = this->vertex_num;
-        while (n > 1) {
-            auto left = GetMin(l, r);
-            auto right = GetMin(l, r);
-            TreeNode* top = new TreeNode(left->weight + right->weight, 0, left, right);
-            r.emplace(top);
-            --n;
-        }
-        return r.front();
-    }
-    typedef std::string Code;
-    void DFS(TreeNode* root, Code code, std::vector<Code>& list) {
-        if (!root) return;
-        if (!root->left && !root->right) {
-            list[root->symbol] = code;
-            return;
-        }
-        if (root->left) DFS(root->left, code + '0', list);
-        if (root->right) DFS(root->right, code + '1', list);
+    std::vector<int> CodeLengths(int root) {
+        std::vector<int> lengths(this->weights.size() + 1, 0);
+        if (root < 0) return lengths;
+        std::vector<int> depth(root + 1, 0);
+        for (int i = root; i >= 0; --i) {
+            auto& node = this->pool[i];
+            if (node.left < 0) lengths[node.symbol] = depth[i];
+            else depth[node.left] = depth[node.right] = depth[i] + 1;
+        }
+        return lengths;
     }
     /**
-     * @brief print the symbol and corresponding code from a huffman tree, 
-     * also count the maximum and minimum length of code
-     * 
-     * @param root 
+     * @brief print the symbol and corresponding code from a huffman tree,
+     * also count the maximum and minimum length of code. The codes are written by an iterative
+     * walk sharing one bit buffer.
+     *
+     * @param root
      */
-    void PrintCodes(TreeNode* root) {
-        Code code;
-        std::vector<Code> list;
-        list.resize(this->vertex_num + 1);
-        DFS(root, code, list);
+    void PrintCodes(int root) {
+        if (root < 0) return;
+        std::vector<std::string> list(this->weights.size() + 1);
+        std::string code;
+        // node, depth and the bit of the edge into the node
+        std::vector<std::pair<int, std::pair<int, char>>> stack(1, std::make_pair(root, std::make_pair(0, '0')));
+        while (!stack.empty()) {
+            int node = stack.back().first, depth = stack.back().second.first;
+            char bit = stack.back().second.second;
+            stack.pop_back();
+            code.resize(depth);
+            if (depth > 0) code[depth - 1] = bit;
+            if (this->pool[node].left < 0) {
+                list[this->pool[node].symbol] = code;
+                continue;
+            }
+            stack.emplace_back(this->pool[node].right, std::make_pair(depth + 1, '1'));
+            stack.emplace_back(this->pool[node].left, std::make_pair(depth + 1, '0'));
+        }
         int min_len = this->vertex_num;
         int max_len = 0;
         // symbol 0 represent non leaf node so it is invalid
@@ -134,13 +428,75 @@ public:
         std::cout << "maximum length of code = " << max_len << "\n";
         std::cout << "minimum length of code = " << min_len << "\n";
     }
+    /**
+     * @brief canonical code of the tree, symbol i is indexed by i. A single symbol gets a 1 bit code.
+     *
+     */
+    CanonicalHuffman Canonical(int root) {
+        std::vector<int> lengths = CodeLengths(root);
+        if (lengths.size() == 2) lengths[1] = 1;
+        return CanonicalHuffman(lengths);
+    }
+    /**
+     * @brief round trip of count symbols drawn from the weights of the data, print the speed of
+     * encoding and decoding in symbols per second and in compressed bytes per second
+     *
+     */
+    void Benchmark(long count = 50000000) {
+        const int root = BuildHuffmanTree();
+        if (root < 0) return;
+        CanonicalHuffman codec = Canonical(root);
+        Release();
+        std::mt19937 gen(2022);
+        std::discrete_distribution<int> pick(this->weights.begin(), this->weights.end());
+        std::vector<uint32_t> data(count), decoded;
+        for (auto& s:data) s = pick(gen) + 1;
+        std::vector<uint64_t> words;
+        // first round trip touches the output buffers, the second one is timed
+        codec.Encode(data, words);
+        codec.Decode(words, count, decoded);
+        auto t0 = std::chrono::steady_clock::now();
+        uint64_t bits = codec.Encode(data, words);
+        auto t1 = std::chrono::steady_clock::now();
+        codec.Decode(words, count, decoded);
+        auto t2 = std::chrono::steady_clock::now();
+        double encode = std::chrono::duration<double>(t1 - t0).count(), decode = std::chrono::duration<double>(t2 - t1).count();
+        std::cout << count << " symbols, " << (double)bits / count << " bits per symbol\n";
+        std::cout << "encode\t" << count / encode / 1e6 << " M symbols/s\t" << bits / 8.0 / encode / 1e9 << " GB/s\n";
+        std::cout << "decode\t" << count / decode / 1e6 << " M symbols/s\t" << bits / 8.0 / decode / 1e9 << " GB/s\n";
+        if (decoded != data) std::cout << "error: round trip differs!\n";
+        std::cout << "skewed alphabet round trip " << (SkewedRoundTrip() ? "ok" : "failed") << "\n";
+    }
+    /**
+     * @brief round trip on n symbols of Fibonacci weights, the worst case of the tree depth, so the
+     * Huffman codes are up to n - 1 bits long and have to be limited
+     *
+     * @return true if the limited codes are prefix free and every symbol decodes back
+     */
+    static bool SkewedRoundTrip(int n = 60) {
+        HuffmanCodes skewed;
+        long a = 1, b = 1;
+        for (int i = 0; i < n; ++i, std::swap(a, b), b += a) skewed.weights.emplace_back(a);
+        skewed.vertex_num = n;
+        const int root = skewed.BuildHuffmanTree();
+        CanonicalHuffman codec = skewed.Canonical(root);
+        skewed.Release();
+        double kraft = 0;
+        for (int i = 1; i <= n; ++i) kraft += std::ldexp(1.0, -codec.Length(i));
+        if (kraft > 1) return false;
+        std::mt19937 gen(n);
+        std::vector<uint32_t> data(100000), decoded;
+        for (size_t i = 0; i < data.size(); ++i) data[i] = i < (size_t)n ? i + 1 : gen() % n + 1;
+        std::vector<uint64_t> words;
+        codec.Encode(data, words);
+        codec.Decode(words, data.size(), decoded);
+        return decoded == data;
+    }
     void Run() {
-        // sort the array with its weight in non decreasing order
-        std::sort(this->symbols.begin(), this->symbols.end(), [](const auto& a, const auto& b){ return (a->weight < b->weight);});
-        //PrintNodes(v);
-        auto root = BuildHuffmanTree(this->symbols);
+        auto root = BuildHuffmanTree();
         PrintCodes(root);
+        Release();
     }
 
 };
-# endif /*  HUFFMAN_CODES_H_ */
\ No newline at end of file
+# endif /*  HUFFMAN_CODES_H_ */
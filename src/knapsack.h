@@ -1,15 +1,27 @@
 # ifndef KNAPSACK_H_
 # define KNAPSACK_H_
 # include "util.h"
+# include "thread_pool.h"
+# include <algorithm>
+# include <chrono>
+# include <climits>
+# if defined(__x86_64__) && defined(__GNUC__)
+# include <immintrin.h>
+# endif
 /**
  * @brief dynamic programming solving knapsack problem
  * example:
  * int main ()
 {
-    Knapsack test;
-    if(!ReadData("../data/_6dfda29c18c77fd14511ba8964c2e265_knapsack_big.txt", true, test))
-        std::cout << "fail opening file";
-    std::cout << test.MaxValue() << "\n";
+    for (std::string name:{"knapsack1", "knapsack_big"}) {
+        Knapsack test;
+        if(!ReadData("../data/_6dfda29c18c77fd14511ba8964c2e265_" + name + ".txt", true, test))
+            std::cout << "fail opening file";
+        std::cout << test.MaxValue() << "\n";
+        std::cout << test.MaxValueAuto() << "\n";
+        print(test.OptimalItems());
+        test.Benchmark();
+    }
     return 0;
 }
  */
@@ -43,11 +55,197 @@ public:
         return true;
     }
     /**
-     * @brief return only max value, without reconstruction of the set
+     * @brief return only max value, without reconstruction of the set.
+     * a single row is updated in place from the largest capacity down, so dp[x - w] still holds
+     * the value of the previous item when dp[x] is updated.
      * 
      * @return int 
      */
     int MaxValue() {
+        if (!CheckData()) {
+            std::cout << "error: data number not match!\n";
+            return -1;
+        }
+        std::vector<int> dp(this->capacity + 1, 0);
+        for (int i = 1; i <= this->num; ++i) AddItem(dp.data(), this->capacity, this->weight[i], this->value[i]);
+        return dp[this->capacity];
+    }
+    /**
+     * @brief choose an exact solver from the capacity and item statistics: the dense row of
+     * MaxValue() costs num * capacity, DP by value costs num * total value. The narrower of the
+     * two rows is used if it fits dense_limit and dense_work, otherwise the Pareto frontier, 
+     * whose size is bounded by both rows but is usually far smaller after pruning.
+     * 
+     * @return long max value
+     */
+    long MaxValueAuto() {
+        if (!CheckData()) {
+            std::cout << "error: data number not match!\n";
+            return -1;
+        }
+        long total_value = 0;
+        for (int i = 1; i <= this->num; ++i) {
+            if (this->weight[i] <= this->capacity) total_value += std::max(0, this->value[i]);
+        }
+        const long row = std::min((long)this->capacity, total_value) + 1;
+        if (row > this->dense_limit || row * this->num > this->dense_work) return MaxValuePareto();
+        return (long)this->capacity <= total_value ? MaxValue() : MaxValueByValue();
+    }
+    /**
+     * @brief DP by value, min_weight[s] is the least weight reaching value s. O(num * total value)
+     * time and O(total value) memory, independent of the capacity.
+     * 
+     * @return long max value
+     */
+    long MaxValueByValue() {
+        if (!CheckData()) {
+            std::cout << "error: data number not match!\n";
+            return -1;
+        }
+        long total_value = 0;
+        for (int i = 1; i <= this->num; ++i) {
+            if (this->weight[i] <= this->capacity && this->value[i] > 0) total_value += this->value[i];
+        }
+        const long inf = LONG_MAX / 2;
+        std::vector<long> min_weight(total_value + 1, inf);
+        min_weight[0] = 0;
+        long reached = 0; // largest value sum of the items so far
+        for (int i = 1; i <= this->num; ++i) {
+            const int v = this->value[i];
+            const long w = this->weight[i];
+            if (w > this->capacity || v <= 0) continue;
+            reached += v;
+            for (long s = reached; s >= v; --s) min_weight[s] = std::min(min_weight[s], min_weight[s - v] + w);
+        }
+        for (long s = total_value; s > 0; --s) if (min_weight[s] <= this->capacity) return s;
+        return 0;
+    }
+    /**
+     * @brief Pareto frontier of (weight, value) pairs. Items are added in decreasing value density,
+     * a pair is dropped when a lighter pair is worth at least as much, or when its value plus the 
+     * fractional knapsack bound of the remaining items cannot beat the best pair found.
+     * The memory depends on the frontier size, not on the capacity.
+     * 
+     * @return long max value
+     */
+    long MaxValuePareto() {
+        if (!CheckData()) {
+            std::cout << "error: data number not match!\n";
+            return -1;
+        }
+        std::vector<int> order;
+        long base = 0; // items of no weight are always taken
+        for (int i = 1; i <= this->num; ++i) {
+            if (this->value[i] <= 0 || this->weight[i] > this->capacity) continue;
+            if (this->weight[i] == 0) base += this->value[i];
+            else order.emplace_back(i);
+        }
+        std::sort(order.begin(), order.end(), [this](int a, int b) {
+            return (long)this->value[a] * this->weight[b] > (long)this->value[b] * this->weight[a];
+        });
+        const int n = order.size();
+        // prefix sums of weight and value in density order for the fractional bound
+        std::vector<long> prefix_w(n + 1, 0), prefix_v(n + 1, 0);
+        for (int k = 0; k < n; ++k) {
+            prefix_w[k + 1] = prefix_w[k] + this->weight[order[k]];
+            prefix_v[k + 1] = prefix_v[k] + this->value[order[k]];
+        }
+        // upper bound of the value added by items order[k..n) within room
+        auto bound = [&](int k, long room) {
+            int j = std::upper_bound(prefix_w.begin() + k, prefix_w.end(), prefix_w[k] + room) - prefix_w.begin() - 1;
+            long value = prefix_v[j] - prefix_v[k];
+            if (j < n) value += (room - (prefix_w[j] - prefix_w[k])) * this->value[order[j]] / this->weight[order[j]];
+            return value;
+        };
+        typedef std::pair<long, long> Pair; // weight, value
+        std::vector<Pair> frontier(1, Pair(0, 0)), shifted, merged;
+        long best = 0;
+        for (int k = 0; k < n; ++k) {
+            const long w = this->weight[order[k]], v = this->value[order[k]];
+            shifted.clear();
+            for (auto& p:frontier) {
+                if (p.first + w > this->capacity) break;
+                shifted.emplace_back(p.first + w, p.second + v);
+                best = std::max(best, p.second + v);
+            }
+            // merge by weight, keep strictly increasing values
+            merged.clear();
+            auto keep = [&](const Pair& p) {
+                if (!merged.empty() && merged.back().second >= p.second) return;
+                if (p.second + bound(k + 1, this->capacity - p.first) < best) return;
+                while (!merged.empty() && merged.back().first == p.first) merged.pop_back();
+                merged.emplace_back(p);
+            };
+            size_t a = 0, b = 0;
+            while (a < frontier.size() || b < shifted.size()) {
+                if (b == shifted.size() || (a < frontier.size() && frontier[a].first <= shifted[b].first)) keep(frontier[a++]);
+                else keep(shifted[b++]);
+            }
+            frontier.swap(merged);
+        }
+        return base + best;
+    }
+    /**
+     * @brief MaxValue() on the thread pool. The rows of consecutive items are double buffered,
+     * every item splits the capacity range into blocks which are updated in parallel, and the 
+     * blocks of one item are joined before the next item starts. The two rows double the memory
+     * traffic of the in place update, so a pool of one worker runs MaxValue() instead.
+     * 
+     * @return int 
+     */
+    int MaxValueParallel() {
+        if (!CheckData()) {
+            std::cout << "error: data number not match!\n";
+            return -1;
+        }
+        const long cells = (long)this->capacity + 1;
+        // a few blocks per worker balance the load, but no block smaller than block_size
+        long blocks = std::min<long>(4L * ThreadPool::Instance().Size(), (cells + this->block_size - 1) / this->block_size);
+        if (blocks <= 1 || ThreadPool::Instance().Size() <= 1) return MaxValue();
+        const long step = (cells + blocks - 1) / blocks;
+        std::vector<int> prev(cells, 0), next(cells);
+        for (int i = 1; i <= this->num; ++i) {
+            const int w = this->weight[i], v = this->value[i];
+            if (w > this->capacity) continue;
+            {
+                TaskGroup group;
+                for (long lo = 0; lo < cells; lo += step) {
+                    long hi = std::min(cells, lo + step);
+                    group.Run([&prev, &next, lo, hi, w, v]{ AddItemTo(prev.data(), next.data(), lo, hi, w, v); });
+                }
+            }
+            prev.swap(next);
+        }
+        return prev[this->capacity];
+    }
+    /**
+     * @brief reconstruct an optimal item set in O(capacity + num) memory, Hirschberg style.
+     * the items are split in halves, one row is computed for each half and the capacity is split
+     * where the two rows sum to the optimum, then both halves are solved in parallel. it costs
+     * about twice the time of MaxValue().
+     * 
+     * @return std::vector<int> chosen item indices in increasing order, starting from 1
+     */
+    std::vector<int> OptimalItems () {
+        std::vector<int> items;
+        if (!CheckData()) {
+            std::cout << "error: data number not match!\n";
+            return items;
+        }
+        std::vector<char> chosen(this->num + 1, 0);
+        {
+            TaskGroup group;
+            SplitItems(1, this->num + 1, this->capacity, chosen, group);
+        }
+        for (int i = 1; i <= this->num; ++i) if (chosen[i]) items.emplace_back(i);
+        return items;
+    }
+    /**
+     * @brief the original two row version of MaxValue(), kept as the reference of Benchmark()
+     * 
+     * @return int 
+     */
+    int MaxValueBaseline() {
         if (!CheckData()) {
             std::cout << "error: data number not match!\n";
             return -1;
@@ -67,5 +265,133 @@ public:
         }
         return dp[this->capacity];
     }
+    /**
+     * @brief dp[x] = max(dp[x], dp[x - w] + v) for x = capacity down to w, in place.
+     * each block of lanes is loaded before it is stored, and all stores so far are above it,
+     * so the lanes read the row of the previous item for any w.
+     * 
+     * @param dp row of capacity + 1 values
+     */
+    static void AddItem (int* dp, int capacity, int w, int v) {
+# if defined(__x86_64__) && defined(__GNUC__)
+        if (HasAVX2()) {
+            AddItemAVX2(dp, capacity, w, v);
+            return;
+        }
+# endif
+        for (int x = capacity; x >= w; --x) dp[x] = std::max(dp[x], dp[x - w] + v);
+    }
+    /**
+     * @brief next[x] = max(prev[x], prev[x - w] + v) for x in [lo, hi), next[x] = prev[x] below w
+     * 
+     */
+    static void AddItemTo (const int* prev, int* next, long lo, long hi, int w, int v) {
+        long x = lo;
+        for (; x < std::min<long>(hi, w); ++x) next[x] = prev[x];
+# if defined(__x86_64__) && defined(__GNUC__)
+        if (HasAVX2()) {
+            AddItemToAVX2(prev, next, x, hi, w, v);
+            return;
+        }
+# endif
+        for (; x < hi; ++x) next[x] = std::max(prev[x], prev[x - w] + v);
+    }
+    // print the time of MaxValueBaseline(), MaxValue() and MaxValueParallel() on the loaded data
+    void Benchmark () {
+        auto measure = [](auto solve, int& result) {
+            auto begin = std::chrono::steady_clock::now();
+            result = solve();
+            auto end = std::chrono::steady_clock::now();
+            return std::chrono::duration<double>(end - begin).count();
+        };
+        int baseline, rolling, parallel;
+        double t0 = measure([this]{ return MaxValueBaseline(); }, baseline);
+        double t1 = measure([this]{ return MaxValue(); }, rolling);
+        double t2 = measure([this]{ return MaxValueParallel(); }, parallel);
+        std::cout << "capacity " << this->capacity << ", items " << this->num << "\n";
+        std::cout << "baseline\t" << t0 << " s\nrolling(avx2 " << HasAVX2() << ")\t" << t1 << " s\tspeedup " << t0 / t1 << "\n";
+        std::cout << "parallel(" << ThreadPool::Instance().Size() << " threads)\t" << t2 << " s\tspeedup " << t0 / t2 << "\n";
+        if (baseline != rolling || baseline != parallel) std::cout << "error: results differ!\n";
+    }
+private:
+    const long parallel_cutoff = 1 << 22; // subproblems of fewer item * capacity cells run serially
+    const long dense_limit = 1L << 27; // widest row chosen by MaxValueAuto()
+    const long dense_work = 1L << 33; // most item * row cells chosen by MaxValueAuto()
+    const long block_size = 1 << 15; // smallest capacity block of MaxValueParallel(), 128 KB of a row
+    // best value of items [first, last) for every capacity 0..capacity
+    std::vector<int> Row (int first, int last, int capacity) {
+        std::vector<int> dp(capacity + 1, 0);
+        for (int i = first; i < last; ++i) AddItem(dp.data(), capacity, this->weight[i], this->value[i]);
+        return dp;
+    }
+    // mark an optimal subset of items [first, last) within capacity
+    void SplitItems (int first, int last, int capacity, std::vector<char>& chosen, TaskGroup& group) {
+        if (first >= last) return;
+        // no need of a row wider than the total weight of the items
+        long total = 0;
+        for (int i = first; i < last; ++i) total += this->weight[i];
+        if (total <= capacity) {
+            for (int i = first; i < last; ++i) chosen[i] = this->value[i] > 0;
+            return;
+        }
+        if (last - first == 1) {
+            chosen[first] = this->weight[first] <= capacity && this->value[first] > 0;
+            return;
+        }
+        int mid = first + (last - first) / 2;
+        bool parallel = (long)(last - first) * capacity >= this->parallel_cutoff;
+        std::vector<int> low, high;
+        if (parallel) {
+            TaskGroup rows;
+            rows.Run([&]{ low = Row(first, mid, capacity); });
+            high = Row(mid, last, capacity);
+            rows.Wait();
+        } else {
+            low = Row(first, mid, capacity);
+            high = Row(mid, last, capacity);
+        }
+        int split = 0;
+        for (int c = 0; c <= capacity; ++c) {
+            if (low[c] + high[capacity - c] > low[split] + high[capacity - split]) split = c;
+        }
+        // release the rows before recursion, so only O(capacity) memory is alive per level
+        std::vector<int>().swap(low);
+        std::vector<int>().swap(high);
+        if (parallel) {
+            group.Run([this, first, mid, split, &chosen, &group]{ SplitItems(first, mid, split, chosen, group); });
+        } else SplitItems(first, mid, split, chosen, group);
+        SplitItems(mid, last, capacity - split, chosen, group);
+    }
+    static bool HasAVX2 () {
+# if defined(__x86_64__) && defined(__GNUC__)
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+# else
+        return false;
+# endif
+    }
+# if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static void AddItemAVX2 (int* dp, int capacity, int w, int v) {
+        const __m256i item = _mm256_set1_epi32(v);
+        int x = capacity;
+        for (; x - 7 >= w; x -= 8) {
+            __m256i keep = _mm256_loadu_si256((const __m256i*)(dp + x - 7));
+            __m256i take = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(dp + x - 7 - w)), item);
+            _mm256_storeu_si256((__m256i*)(dp + x - 7), _mm256_max_epi32(keep, take));
+        }
+        for (; x >= w; --x) dp[x] = std::max(dp[x], dp[x - w] + v);
+    }
+    __attribute__((target("avx2")))
+    static void AddItemToAVX2 (const int* prev, int* next, long x, long hi, int w, int v) {
+        const __m256i item = _mm256_set1_epi32(v);
+        for (; x + 8 <= hi; x += 8) {
+            __m256i keep = _mm256_loadu_si256((const __m256i*)(prev + x));
+            __m256i take = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(prev + x - w)), item);
+            _mm256_storeu_si256((__m256i*)(next + x), _mm256_max_epi32(keep, take));
+        }
+        for (; x < hi; ++x) next[x] = std::max(prev[x], prev[x - w] + v);
+    }
+# endif
 };
 # endif /* KNAPSACK_H_ */
\ No newline at end of file
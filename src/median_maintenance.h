@@ -1,6 +1,10 @@
 # ifndef MEDIUM_MAINTENANCE_H_
 # define MEDIUM_MAINTENANCE_H_
-# include <queue>
+# include <vector>
+# include <deque>
+# include <algorithm>
+# include <cmath>
+# include <random>
 /**
  * @brief Given a stream of unsorted numbers, arriving one by one. 
  * Letting xi denote the ith number of the file, the kth median m[k]
@@ -11,8 +15,32 @@
  */
 class MediumMaintenance {
 private:
-    std::priority_queue<int, std::vector<int>, std::less<int>> low_heap;
-    std::priority_queue<int, std::vector<int>, std::greater<int>> high_heap;
+    // binary heaps kept in vectors, so a batch can be appended and heapified at once
+    std::vector<int> low_heap; // max heap
+    std::vector<int> high_heap; // min heap
+    // restore the heap after appending the elements from position begin
+    template <class Compare>
+    static void Heapify (std::vector<int>& heap, size_t begin, Compare comp) {
+        size_t added = heap.size() - begin;
+        // rebuilding costs O(n), pushing one by one O(added * log(n))
+        if (added * 16 > heap.size()) std::make_heap(heap.begin(), heap.end(), comp);
+        else for (size_t i = begin + 1; i <= heap.size(); ++i) std::push_heap(heap.begin(), heap.begin() + i, comp);
+    }
+    // move tops until the low heap holds the ceil(k / 2) smallest samples
+    void Rebalance () {
+        while (this->low_heap.size() > this->high_heap.size() + 1) {
+            std::pop_heap(this->low_heap.begin(), this->low_heap.end(), std::less<int>());
+            this->high_heap.emplace_back(this->low_heap.back());
+            this->low_heap.pop_back();
+            std::push_heap(this->high_heap.begin(), this->high_heap.end(), std::greater<int>());
+        }
+        while (this->high_heap.size() > this->low_heap.size()) {
+            std::pop_heap(this->high_heap.begin(), this->high_heap.end(), std::greater<int>());
+            this->low_heap.emplace_back(this->high_heap.back());
+            this->high_heap.pop_back();
+            std::push_heap(this->low_heap.begin(), this->low_heap.end(), std::less<int>());
+        }
+    }
 public:
 /**
  * @brief Construct a new Medium Maintenance object
@@ -26,21 +54,361 @@ public:
  * @return int updated medium number
  */
     int update (int input) { 
-        high_heap.push(input);
+        if (!this->low_heap.empty() && input <= this->low_heap.front()) {
+            this->low_heap.emplace_back(input);
+            std::push_heap(this->low_heap.begin(), this->low_heap.end(), std::less<int>());
+        } else {
+            this->high_heap.emplace_back(input);
+            std::push_heap(this->high_heap.begin(), this->high_heap.end(), std::greater<int>());
+        }
         // rebalancing the size of both heap
-        while (high_heap.size() > low_heap.size()) {
-            low_heap.push(high_heap.top());
-            high_heap.pop();
-        }
-        if (high_heap.top() < low_heap.top()) {
-            auto low = low_heap.top();
-            low_heap.pop();
-            auto high = high_heap.top();
-            high_heap.pop();
-            low_heap.push(high);
-            high_heap.push(low);
-        }
-        return low_heap.top();
+        Rebalance();
+        return this->low_heap.front();
+    }
+/**
+ * @brief adding a batch of samples, split around the current median and rebalanced once. When the
+ * batch leaves one half with many extra samples, as a sorted run does, the extra ones are selected
+ * by nth_element over that half and moved at once instead of one heap operation each.
+ * 
+ * @param first begin of the batch
+ * @param last end of the batch
+ * @return int medium number after the whole batch, undefined if no sample was received yet
+ */
+    template <class Iterator>
+    int UpdateMany (Iterator first, Iterator last) {
+        if (first == last) return this->low_heap.empty() ? 0 : this->low_heap.front();
+        if (this->low_heap.empty()) this->low_heap.emplace_back(*first++);
+        // everything not larger than the current median belongs to the low half
+        const int pivot = this->low_heap.front();
+        size_t low_begin = this->low_heap.size(), high_begin = this->high_heap.size();
+        for (; first != last; ++first) {
+            if (*first <= pivot) this->low_heap.emplace_back(*first);
+            else this->high_heap.emplace_back(*first);
+        }
+        // the low half holds the ceil(k / 2) smallest samples
+        const size_t want = (this->low_heap.size() + this->high_heap.size() + 1) / 2;
+        std::vector<int>& low = this->low_heap;
+        std::vector<int>& high = this->high_heap;
+        if (low.size() > want && (low.size() - want) * 16 > low.size()) {
+            // the largest samples of the low half move up
+            std::nth_element(low.begin(), low.begin() + want, low.end());
+            high.insert(high.end(), low.begin() + want, low.end());
+            low.resize(want);
+            low_begin = 0;
+        } else if (low.size() < want && (want - low.size()) * 16 > high.size()) {
+            // the smallest samples of the high half move down
+            const size_t moved = want - low.size();
+            std::nth_element(high.begin(), high.begin() + moved, high.end());
+            low.insert(low.end(), high.begin(), high.begin() + moved);
+            high.erase(high.begin(), high.begin() + moved);
+            high_begin = 0;
+        }
+        Heapify(low, low_begin, std::less<int>());
+        Heapify(high, high_begin, std::greater<int>());
+        Rebalance();
+        return low.front();
+    }
+    int UpdateMany (const std::vector<int>& input) {
+        return UpdateMany(input.begin(), input.end());
+    }
+};
+/**
+ * @brief KLL quantile sketch, https://arxiv.org/abs/1603.05346
+ * approximate median and quantiles of a stream in O(k * log(n / k)) memory. Level h keeps samples
+ * of weight 2^h; a full level is sorted and every other sample from a random offset is promoted,
+ * so the sketches of several shards can be merged into the sketch of the whole stream.
+ * The rank error is within NormalizedRankError() * n with high probability.
+ * example:
+ * int main ()
+{
+    std::vector<QuantileSketch> shards(4, QuantileSketch(200));
+    for (int i = 0; i < 1000000; ++i) shards[i % 4].update(i);
+    for (int i = 1; i < 4; ++i) shards[0].Merge(shards[i]);
+    std::cout << shards[0].Quantile(0.5) << " " << shards[0].Quantile(0.99) << "\n";
+    return 0;
+}
+ */
+class QuantileSketch {
+private:
+    size_t k;
+    long count;
+    std::vector<std::vector<int>> levels;
+    std::vector<size_t> capacity; // capacity of each level
+    size_t retained; // samples kept over all levels
+    size_t total_capacity;
+    std::mt19937 rng;
+    // capacity shrinks by 2/3 per level below the top, but at least 2
+    void Grow () {
+        this->levels.emplace_back();
+        const size_t height = this->levels.size();
+        this->capacity.resize(height);
+        this->total_capacity = 0;
+        for (size_t h = 0; h < height; ++h) {
+            this->capacity[h] = std::max<size_t>(2, (size_t)std::ceil(this->k * std::pow(2.0 / 3.0, height - 1 - h)));
+            this->total_capacity += this->capacity[h];
+        }
+    }
+    // promote half of the lowest full level until the sketch fits its capacity
+    void Compress () {
+        while (this->retained >= this->total_capacity) {
+            size_t h = 0;
+            while (this->levels[h].size() < this->capacity[h]) ++h;
+            if (h + 1 == this->levels.size()) Grow();
+            auto& level = this->levels[h];
+            std::sort(level.begin(), level.end());
+            // an odd sample out stays on this level
+            size_t pairs = level.size() / 2;
+            size_t offset = this->rng() & 1;
+            auto& next = this->levels[h + 1];
+            for (size_t i = 0; i < pairs; ++i) next.emplace_back(level[2 * i + offset]);
+            if (level.size() % 2 == 1) {
+                level[0] = level.back();
+                level.resize(1);
+            } else level.clear();
+            this->retained -= pairs;
+        }
+    }
+public:
+    /**
+     * @brief Construct a new Quantile Sketch object
+     * 
+     * @param k accuracy parameter, larger k retains more samples and lowers the error
+     * @param seed random seed of the compaction offsets
+     */
+    QuantileSketch (size_t k = 200, unsigned seed = 1) : k(std::max<size_t>(k, 2)), count(0), retained(0), rng(seed) {
+        Grow();
+    }
+    long Count () { return this->count; }
+    void Insert (int input) {
+        this->levels[0].emplace_back(input);
+        ++this->count;
+        if (++this->retained >= this->total_capacity) Compress();
+    }
+    template <class Iterator>
+    void InsertMany (Iterator first, Iterator last) {
+        for (; first != last; ++first) Insert(*first);
+    }
+    // fold the samples of another sketch with the same k into this one
+    void Merge (const QuantileSketch& other) {
+        while (this->levels.size() < other.levels.size()) Grow();
+        for (size_t h = 0; h < other.levels.size(); ++h) {
+            this->levels[h].insert(this->levels[h].end(), other.levels[h].begin(), other.levels[h].end());
+        }
+        this->count += other.count;
+        this->retained += other.retained;
+        Compress();
+    }
+    /**
+     * @brief approximate number of samples not larger than value
+     * 
+     */
+    long Rank (int value) {
+        long rank = 0;
+        for (size_t h = 0; h < this->levels.size(); ++h) {
+            for (auto x:this->levels[h]) if (x <= value) rank += 1L << h;
+        }
+        return rank;
+    }
+    /**
+     * @brief approximate nearest rank quantile, the same definition as OrderStatisticSet::Quantile()
+     * 
+     * @param q in [0, 1]
+     */
+    int Quantile (double q) {
+        std::vector<std::pair<int, long>> weighted;
+        for (size_t h = 0; h < this->levels.size(); ++h) {
+            for (auto x:this->levels[h]) weighted.emplace_back(x, 1L << h);
+        }
+        if (weighted.empty()) return 0;
+        std::sort(weighted.begin(), weighted.end());
+        long target = std::max(1L, (long)std::ceil(q * this->count));
+        long rank = 0;
+        for (auto& w:weighted) {
+            rank += w.second;
+            if (rank >= target) return w.first;
+        }
+        return weighted.back().first;
+    }
+    /**
+     * @brief normalized rank error at 99% confidence for a single quantile, empirical fit of
+     * the Apache DataSketches KLL implementation
+     * 
+     */
+    double NormalizedRankError () {
+        return 2.296 / std::pow((double)this->k, 0.9723);
+    }
+    // adding new sample and feedback the approximate medium
+    int update (int input) {
+        Insert(input);
+        return Quantile(0.5);
+    }
+};
+/**
+ * @brief order statistic multiset of sorted buckets. Samples are kept in sorted buckets of at most
+ * 2 * bucket_size values, the first value of each bucket locates a value by binary search and a 
+ * Fenwick tree over bucket sizes locates a rank. Insert, Erase and Kth cost O(log(n) + bucket_size),
+ * where the bucket_size part is a short contiguous move, so the cost hardly grows with n.
+ * 
+ */
+class OrderStatisticSet {
+private:
+    const size_t bucket_size = 512;
+    std::vector<std::vector<int>> buckets;
+    std::vector<int> firsts; // first value of each bucket
+    std::vector<long> tree; // Fenwick tree over bucket sizes, from index 1
+    long total;
+    void Add (size_t b, long delta) {
+        for (size_t i = b + 1; i < this->tree.size(); i += i & -i) this->tree[i] += delta;
+    }
+    // rebuild the index after buckets were split, merged or removed, O(number of buckets)
+    void Rebuild () {
+        const size_t n = this->buckets.size();
+        this->firsts.resize(n);
+        this->tree.assign(n + 1, 0);
+        for (size_t b = 0; b < n; ++b) {
+            this->firsts[b] = this->buckets[b].front();
+            this->tree[b + 1] += this->buckets[b].size();
+            size_t parent = (b + 1) + ((b + 1) & -(b + 1));
+            if (parent <= n) this->tree[parent] += this->tree[b + 1];
+        }
+    }
+    // last bucket whose first value is not larger than value, 0 if none
+    size_t Locate (int value) {
+        size_t b = std::upper_bound(this->firsts.begin(), this->firsts.end(), value) - this->firsts.begin();
+        return b ? b - 1 : 0;
+    }
+public:
+    OrderStatisticSet () : total(0) {}
+    long Size () { return this->total; }
+    void Insert (int value) {
+        ++this->total;
+        if (this->buckets.empty()) {
+            this->buckets.emplace_back(1, value);
+            Rebuild();
+            return;
+        }
+        size_t b = Locate(value);
+        auto& bucket = this->buckets[b];
+        bucket.insert(std::upper_bound(bucket.begin(), bucket.end(), value), value);
+        this->firsts[b] = bucket.front();
+        if (bucket.size() > 2 * this->bucket_size) {
+            // split the full bucket in halves
+            std::vector<int> upper(bucket.begin() + this->bucket_size, bucket.end());
+            bucket.resize(this->bucket_size);
+            this->buckets.insert(this->buckets.begin() + b + 1, std::move(upper));
+            Rebuild();
+        } else Add(b, 1);
+    }
+    /**
+     * @brief remove one sample of the value
+     * 
+     * @param value 
+     * @return true if the value was present
+     */
+    bool Erase (int value) {
+        if (this->buckets.empty()) return false;
+        // if an earlier bucket held the value, this bucket would start with it as well
+        size_t b = Locate(value);
+        auto& bucket = this->buckets[b];
+        auto it = std::lower_bound(bucket.begin(), bucket.end(), value);
+        if (it == bucket.end() || *it != value) return false;
+        bucket.erase(it);
+        --this->total;
+        if (bucket.empty()) {
+            this->buckets.erase(this->buckets.begin() + b);
+            Rebuild();
+        } else if (bucket.size() < this->bucket_size / 4 && b + 1 < this->buckets.size()) {
+            // merge the sparse bucket into its successor
+            auto& next = this->buckets[b + 1];
+            next.insert(next.begin(), bucket.begin(), bucket.end());
+            this->buckets.erase(this->buckets.begin() + b);
+            if (this->buckets[b].size() > 2 * this->bucket_size) {
+                std::vector<int> upper(this->buckets[b].begin() + this->bucket_size, this->buckets[b].end());
+                this->buckets[b].resize(this->bucket_size);
+                this->buckets.insert(this->buckets.begin() + b + 1, std::move(upper));
+            }
+            Rebuild();
+        } else {
+            this->firsts[b] = bucket.front();
+            Add(b, -1);
+        }
+        return true;
+    }
+    /**
+     * @brief k-th smallest sample, 1 <= k <= Size(), 0 for k out of range
+     * 
+     */
+    int Kth (long k) {
+        if (k < 1 || k > Size()) return 0;
+        // descend the Fenwick tree to the bucket holding rank k
+        size_t pos = 0;
+        size_t step = 1;
+        while (step * 2 < this->tree.size()) step *= 2;
+        for (; step > 0; step >>= 1) {
+            if (pos + step < this->tree.size() && this->tree[pos + step] < k) {
+                pos += step;
+                k -= this->tree[pos];
+            }
+        }
+        return this->buckets[pos][k - 1];
+    }
+    /**
+     * @brief nearest rank quantile, the ceil(q * n)-th smallest sample, so Quantile(0.5) is the 
+     * median defined by MediumMaintenance, 0 for an empty set
+     * 
+     * @param q in [0, 1]
+     */
+    int Quantile (double q) {
+        long n = Size();
+        if (n == 0) return 0;
+        long k = (long)std::ceil(q * n);
+        return Kth(std::min(n, std::max(1L, k)));
+    }
+};
+/**
+ * @brief median and quantiles of the last W samples of a stream, backed by an order statistic set,
+ * so the cost per sample stays nearly flat however large the window grows
+ * example:
+ * int main ()
+{
+    WindowedMedian test(100);
+    std::vector<int> v;
+    ReadVectorData("../data/_6ec67df2804ff4b58ab21c12edcb21f8_Median.txt", v);
+    for (auto i:v) test.update(i);
+    std::cout << test.Quantile(0.5) << ", " << test.Quantile(0.99) << "\n";
+    return 0;
+}
+ */
+class WindowedMedian {
+private:
+    size_t window;
+    std::deque<int> samples; // samples inside the window in arrival order
+    OrderStatisticSet set;
+public:
+    // a window of 0 is taken as 1, the latest sample only
+    WindowedMedian (size_t window) : window(std::max<size_t>(window, 1)) {}
+    void Insert (int input) {
+        this->samples.emplace_back(input);
+        this->set.Insert(input);
+        if (this->samples.size() > this->window) Erase();
+    }
+    // remove the oldest sample of the window
+    void Erase () {
+        if (this->samples.empty()) return;
+        this->set.Erase(this->samples.front());
+        this->samples.pop_front();
+    }
+    int Quantile (double q) { return this->set.Quantile(q); }
+    long Size () { return this->set.Size(); }
+/**
+ * @brief adding new sample and feedback the median of the last window samples
+ * 
+ * @param input received sample
+ * @return int updated medium number
+ */
+    int update (int input) {
+        Insert(input);
+        return Quantile(0.5);
     }
 };
 # endif /* MEDIUM_MAINTENANCE_H_ */
\ No newline at end of file
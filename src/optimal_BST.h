@@ -9,11 +9,26 @@
     OptimalBST test;
     std::vector<int> v = {20, 5, 17, 10, 20, 3, 25};
     std::cout << test.FindMinCost(v) << "\n";
+    OptimalBST::Tree tree = test.Build(v);
+    std::cout << tree.cost << ", root " << tree.root << "\n";
+    print(tree.left);
+    print(tree.right);
     return 0;
 }
  */
 class OptimalBST {
 public:
+    /**
+     * @brief shape of the optimal tree, keys are numbered from 1 in the order of the input,
+     * child 0 means no child
+     * 
+     */
+    struct Tree {
+        int cost;
+        int root;
+        std::vector<int> left; // left[key] is the left child of key
+        std::vector<int> right;
+    };
     OptimalBST () {}
     /**
      * @brief find minimum search cost of the binary search tree. complexity O(n^3),
@@ -50,5 +65,76 @@ public:
         }
         return dp[0][n];
     }
+    // minimum search cost in O(n^2), see Build()
+    int FindMinCostKnuth(std::vector<int>& v) {
+        return Build(v).cost;
+    }
+    /**
+     * @brief optimal tree in O(n^2) time by Knuth's optimization: the root of keys [i, j) lies 
+     * between the roots of [i, j-1) and [i+1, j), so each diagonal of the table costs O(n) in total.
+     * the cost and root tables are flat upper triangles, and the weight of [i, j) is a difference
+     * of prefix sums.
+     * 
+     * @param v the array of frequency
+     * @return Tree 
+     */
+    Tree Build(std::vector<int>& v) {
+        const int n = v.size();
+        Tree tree;
+        tree.left.assign(n + 1, 0);
+        tree.right.assign(n + 1, 0);
+        tree.root = 0;
+        std::vector<long> prefix(n + 1, 0);
+        for (int i = 0; i < n; ++i) prefix[i + 1] = prefix[i] + v[i];
+        // entry (i, j) of 0 <= i <= j <= n stored by diagonal len = j - i, then by i. the k loop of
+        // one entry still strides across diagonals, but its root window is short, and the next i
+        // reads the entries next to them on the same few diagonals, which are still in cache
+        std::vector<size_t> diagonal(n + 2);
+        for (int len = 0; len <= n + 1; ++len) diagonal[len] = (size_t)len * (n + 1) - (size_t)len * (len - 1) / 2;
+        auto at = [&diagonal](int i, int j) { return diagonal[j - i] + i; };
+        std::vector<int> dp(diagonal[n + 1], 0); // cost of keys [i, j)
+        std::vector<int> root(diagonal[n + 1], 0); // root key of [i, j), from 1
+        for (int len = 1; len <= n; ++len) {
+            for (int i = 0; i + len <= n; ++i) {
+                const int j = i + len;
+                int lo = i + 1, hi = j;
+                if (len > 1) {
+                    lo = root[at(i, j - 1)];
+                    hi = root[at(i + 1, j)];
+                }
+                int min = INT32_MAX;
+                int r = lo;
+                for (int k = lo; k <= hi; ++k) {
+                    // key k splits [i, j) into [i, k-1) and [k, j)
+                    int cost = dp[at(i, k - 1)] + dp[at(k, j)];
+                    if (cost < min) {
+                        min = cost;
+                        r = k;
+                    }
+                }
+                dp[at(i, j)] = min + (int)(prefix[j] - prefix[i]);
+                root[at(i, j)] = r;
+            }
+        }
+        tree.cost = dp[at(0, n)];
+        if (n == 0) return tree;
+        // unfold the root table without recursion
+        tree.root = root[at(0, n)];
+        std::vector<std::pair<int, int>> stack(1, std::make_pair(0, n));
+        while (!stack.empty()) {
+            int i = stack.back().first, j = stack.back().second;
+            stack.pop_back();
+            int r = root[at(i, j)];
+            if (r - 1 > i) {
+                tree.left[r] = root[at(i, r - 1)];
+                stack.emplace_back(i, r - 1);
+            }
+            if (j > r) {
+                tree.right[r] = root[at(r, j)];
+                stack.emplace_back(r, j);
+            }
+        }
+        return tree;
+    }
 };
 # endif /* OPTIMAL_BST_H_ */
\ No newline at end of file
@@ -3,19 +3,53 @@
 # include <vector>
 # include <iostream>
 # include "util.h"
+# include "thread_pool.h"
 # include <algorithm>
+# include <random>
+# include <cmath>
+# include <chrono>
+# include <climits>
+# if defined(__x86_64__) && defined(__GNUC__)
+# include <immintrin.h>
+# endif
 class QuickSort {
+private:
+    std::mt19937 rng; // source of random pivots
+    const int insertion_cutoff = 16; // ranges no larger than this are finished by insertion sort
+    const int parallel_cutoff = 1 << 14; // ranges no larger than this are sorted by a single thread
+    const long sample_sort_cutoff = 1L << 24; // ParallelSort switches to sample sort from this size
 public:
-    QuickSort () {}
+    QuickSort () : rng(std::random_device{}()) {}
+    // fixed seed, for reproducible comparison counts in random mode
+    QuickSort (unsigned seed) : rng(seed) {}
     enum pivot_mode {
         first,      // first element of the divided range
         last,       // last element of the divided range
         random,     // random element of the divided range
         middle,     // middle element of the divided range (k-th element of 2*k size)
-        median      /** choose the index with median value from three elements (
+        median,     /** choose the index with median value from three elements (
                     * the first, the last, and the middle element) of a vector 
                     * with distinct value **/
+        ninther     /** Tukey's ninther: median of the medians of three groups of
+                    * three elements evenly spread over the range **/
     };
+    /**
+     * @brief index of the median value among three given indexes
+     * 
+     * @param v input vector
+     * @param a 
+     * @param b 
+     * @param c 
+     * @return int index holding the median value
+     */
+    int MedianOfThree(std::vector<int>& v, int a, int b, int c) {
+        if (v[a] < v[b]) {
+            if (v[b] < v[c]) return b;
+            return (v[a] < v[c]) ? c : a;
+        }
+        if (v[a] < v[c]) return a;
+        return (v[b] < v[c]) ? c : b;
+    }
     /**
      * @brief given chosen pivot position and return the index 
      * 
@@ -28,7 +62,7 @@ public:
     int PickPivot(std::vector<int>& v, int l, int r, pivot_mode mode = first) {
         if (mode == first) return l;
         else if (mode == last) return r;
-        else if (mode == random) std::cout << "random mode not implement yet";
+        else if (mode == random) return std::uniform_int_distribution<int>(l, r)(rng);
         else if (mode == middle) return l + (r - l)/2;
         else if (mode == median) { 
             int middle = l + (r - l)/2;
@@ -39,6 +73,16 @@ public:
                 if (v[i] == value[1]) return i;
             }
         }
+        else if (mode == ninther) {
+            int n = r - l + 1;
+            int middle = l + (r - l)/2;
+            if (n < 9) return MedianOfThree(v, l, middle, r);
+            int step = n / 8;
+            return MedianOfThree(v,
+                MedianOfThree(v, l, l + step, l + 2*step),
+                MedianOfThree(v, middle - step, middle, middle + step),
+                MedianOfThree(v, r - 2*step, r - step, r));
+        }
         else std::cout << "this mode not implement yet";
         return l;
     }
@@ -74,13 +118,508 @@ public:
      */
     int Sort (std::vector<int>& v, int l, int r, pivot_mode mode) {
         int count = 0;
-        int p = PickPivot(v, l, r, mode);
         if (r > l) {
+            int p = PickPivot(v, l, r, mode);
             count += Partition(v, l, r, p);
             count += Sort(v, l, p - 1, mode);
             count += Sort(v, p + 1, r, mode);
         }
         return count;
     }
+    /**
+     * @brief Dutch national flag partition, elements equal to the pivot are gathered 
+     * in the middle and excluded from further recursion
+     * 
+     * @param v input vector, duplicates allowed
+     * @param l left index of divided range of vector
+     * @param r right index of divided range of vector
+     * @param pivot index of pivot
+     * @param lt updated to the first index of elements equal to pivot
+     * @param gt updated to the last index of elements equal to pivot
+     * @return long counted comparison times
+     */
+    long Partition3 (std::vector<int>& v, int l, int r, int pivot, int& lt, int& gt) {
+        const int p = v[pivot];
+        long count = 0;
+        lt = l;
+        gt = r;
+        int i = l;
+        while (i <= gt) {
+            ++count;
+            if (v[i] < p) std::swap(v[lt++], v[i++]);
+            else {
+                ++count;
+                if (p < v[i]) std::swap(v[i], v[gt--]);
+                else ++i;
+            }
+        }
+        return count;
+    }
+    /**
+     * @brief O(n^2) insertion sort, fast for short ranges
+     * 
+     * @param v input vector
+     * @param l left index of range
+     * @param r right index of range
+     * @return long counted comparison times
+     */
+    long InsertionSort (std::vector<int>& v, int l, int r) {
+        long count = 0;
+        for (int i = l + 1; i <= r; ++i) {
+            int key = v[i];
+            int j = i - 1;
+            while (j >= l && (++count, key < v[j])) {
+                v[j + 1] = v[j];
+                --j;
+            }
+            v[j + 1] = key;
+        }
+        return count;
+    }
+    /**
+     * @brief O(n*log(n)) worst case heap sort of the range, the fallback when
+     * the recursion of IntroSort gets too deep
+     * 
+     * @param v input vector
+     * @param l left index of range
+     * @param r right index of range
+     * @return long counted comparison times
+     */
+    long HeapSort (std::vector<int>& v, int l, int r) {
+        long count = 0;
+        int n = r - l + 1;
+        int* a = v.data() + l;
+        // restore max heap property of the sub tree rooted at i, within first m elements
+        auto sift_down = [&](int i, int m) {
+            int x = a[i];
+            while (2*i + 1 < m) {
+                int child = 2*i + 1;
+                if (child + 1 < m && (++count, a[child] < a[child + 1])) ++child;
+                ++count;
+                if (!(x < a[child])) break;
+                a[i] = a[child];
+                i = child;
+            }
+            a[i] = x;
+        };
+        for (int i = n/2 - 1; i >= 0; --i) sift_down(i, n);
+        for (int m = n - 1; m > 0; --m) {
+            std::swap(a[0], a[m]);
+            sift_down(0, m);
+        }
+        return count;
+    }
+    enum partition_scheme {
+        three_way,  // Dutch national flag partition of Partition3()
+        block,      // branch free block partition of BlockPartition()
+        simd        /** vectorized partition with AVX-512 or AVX2 chosen at runtime,
+                    * falls back to block partition on other CPUs **/
+    };
+    /**
+     * @brief branch free block partition (BlockQuicksort, Edelkamp and Weiss). Offsets of 
+     * misplaced elements of one block from each end are collected without branching 
+     * on the comparison result, then swapped pairwise.
+     * 
+     * @param first pointer to the first element of the range
+     * @param last pointer past the last element of the range
+     * @param bound elements less than bound are moved to the front
+     * @return int* the first element not less than bound
+     */
+    int* BlockPartition (int* first, int* last, const int bound) {
+        const int B = 64;
+        unsigned char offset_l[B], offset_r[B];
+        int num_l = 0, num_r = 0, start_l = 0, start_r = 0;
+        int* l = first;
+        int* r = last;
+        // invariant: [first, l) < bound and [r, last) >= bound
+        while (r - l > 2 * B) {
+            if (num_l == 0) {
+                start_l = 0;
+                for (int i = 0; i < B; ++i) {
+                    offset_l[num_l] = i;
+                    num_l += !(l[i] < bound);
+                }
+            }
+            if (num_r == 0) {
+                start_r = 0;
+                for (int i = 0; i < B; ++i) {
+                    offset_r[num_r] = i;
+                    num_r += (r[-1 - i] < bound);
+                }
+            }
+            int num = std::min(num_l, num_r);
+            for (int i = 0; i < num; ++i) 
+                std::swap(l[offset_l[start_l + i]], r[-1 - offset_r[start_r + i]]);
+            num_l -= num;
+            num_r -= num;
+            start_l += num;
+            start_r += num;
+            if (num_l == 0) l += B;
+            if (num_r == 0) r -= B;
+        }
+        // branch free Lomuto partition of the rest, at most 3 blocks
+        int* m = l;
+        for (int* it = l; it < r; ++it) {
+            int x = *it;
+            bool smaller = x < bound;
+            *it = *m;
+            *m = x;
+            m += smaller;
+        }
+        return m;
+    }
+# if defined(__x86_64__) && defined(__GNUC__)
+    /**
+     * @brief vectorized partition with AVX2, elements less than bound are compacted 
+     * in place by lane permutation, the others are gathered in scratch and copied back
+     * 
+     * @param first pointer to the first element of the range
+     * @param last pointer past the last element of the range
+     * @param bound elements less than bound are moved to the front
+     * @param scratch buffer with at least (last - first + 8) elements
+     * @return int* the first element not less than bound
+     */
+    __attribute__((target("avx2,popcnt")))
+    int* PartitionAVX2 (int* first, int* last, const int bound, int* scratch) {
+        // permutation moving the lanes selected by mask to the front
+        static const auto table = [] {
+            std::vector<int> t(256 * 8, 0);
+            for (int mask = 0; mask < 256; ++mask) {
+                int k = 0;
+                for (int lane = 0; lane < 8; ++lane) {
+                    if (mask & (1 << lane)) t[mask * 8 + k++] = lane;
+                }
+            }
+            return t;
+        }();
+        int* w = first;
+        int* rs = scratch;
+        int* it = first;
+        const __m256i b = _mm256_set1_epi32(bound);
+        for (; last - it >= 8; it += 8) {
+            __m256i x = _mm256_loadu_si256((const __m256i*)it);
+            int mask = _mm256_movemask_ps(_mm256_castsi256_ps(_mm256_cmpgt_epi32(b, x)));
+            __m256i pl = _mm256_loadu_si256((const __m256i*)(table.data() + mask * 8));
+            __m256i pr = _mm256_loadu_si256((const __m256i*)(table.data() + (~mask & 0xff) * 8));
+            // the full store only overwrites elements that are already loaded
+            _mm256_storeu_si256((__m256i*)w, _mm256_permutevar8x32_epi32(x, pl));
+            _mm256_storeu_si256((__m256i*)rs, _mm256_permutevar8x32_epi32(x, pr));
+            int c = __builtin_popcount(mask);
+            w += c;
+            rs += 8 - c;
+        }
+        for (; it < last; ++it) {
+            if (*it < bound) *w++ = *it;
+            else *rs++ = *it;
+        }
+        std::copy(scratch, rs, w);
+        return w;
+    }
+    /**
+     * @brief vectorized partition with AVX-512 compress store, same contract as PartitionAVX2()
+     */
+    __attribute__((target("avx512f,popcnt")))
+    int* PartitionAVX512 (int* first, int* last, const int bound, int* scratch) {
+        int* w = first;
+        int* rs = scratch;
+        int* it = first;
+        const __m512i b = _mm512_set1_epi32(bound);
+        for (; last - it >= 16; it += 16) {
+            __m512i x = _mm512_loadu_si512(it);
+            __mmask16 mask = _mm512_cmplt_epi32_mask(x, b);
+            _mm512_mask_compressstoreu_epi32(w, mask, x);
+            _mm512_mask_compressstoreu_epi32(rs, (__mmask16)~mask, x);
+            int c = __builtin_popcount(mask);
+            w += c;
+            rs += 16 - c;
+        }
+        for (; it < last; ++it) {
+            if (*it < bound) *w++ = *it;
+            else *rs++ = *it;
+        }
+        std::copy(scratch, rs, w);
+        return w;
+    }
+# endif
+    /**
+     * @brief the widest vector instruction set supported by the running CPU
+     * 
+     * @return int 2 for AVX-512, 1 for AVX2, 0 otherwise
+     */
+    static int SimdLevel () {
+# if defined(__x86_64__) && defined(__GNUC__)
+        static const int level = __builtin_cpu_supports("avx512f") ? 2 : 
+            (__builtin_cpu_supports("avx2") ? 1 : 0);
+        return level;
+# else
+        return 0;
+# endif
+    }
+    /**
+     * @brief 2-way partition of [first, last) with the given scheme
+     * 
+     * @return int* the first element not less than bound
+     */
+    int* PartitionBy (int* first, int* last, const int bound, partition_scheme scheme) {
+# if defined(__x86_64__) && defined(__GNUC__)
+        if (scheme == simd) {
+            if (this->scratch.size() < (size_t)(last - first) + 16) this->scratch.resize(last - first + 16);
+            if (SimdLevel() == 2) return PartitionAVX512(first, last, bound, this->scratch.data());
+            if (SimdLevel() == 1) return PartitionAVX2(first, last, bound, this->scratch.data());
+        }
+# endif
+        return BlockPartition(first, last, bound);
+    }
+    /**
+     * @brief introspective sort: quick sort with 3-way partition, ranges shorter than 
+     * insertion_cutoff are left for insertion sort, and heap sort takes over once the 
+     * recursion depth exceeds 2*log2(n). Recursion only goes into the smaller side so 
+     * the stack depth is O(log(n)) even for adversarial input.
+     * With block or simd scheme each element is compared once per partition, and runs 
+     * of elements equal to the pivot are put aside as in pdqsort.
+     * 
+     * @param v input vector, duplicates allowed
+     * @param l left index of range
+     * @param r right index of range
+     * @param mode determine pivot chosen position, ninther as default
+     * @param scheme partition algorithm, three_way as default
+     * @return long counted comparison times
+     */
+    long IntroSort (std::vector<int>& v, int l, int r, pivot_mode mode = ninther, partition_scheme scheme = three_way) {
+        if (r <= l) return 0;
+        int depth_limit = 2 * (int)std::log2(r - l + 1);
+        if (scheme == three_way) return IntroSortLoop(v, l, r, mode, depth_limit);
+        return IntroSortLoop(v, l, r, mode, scheme, depth_limit, true);
+    }
+    /**
+     * @brief multi-threaded version of IntroSort with block partition. The smaller side of each 
+     * partition is forked onto the work stealing pool until ranges shrink below parallel_cutoff,
+     * inputs larger than sample_sort_cutoff are handled by SampleSort().
+     * 
+     * @param v input vector, duplicates allowed
+     * @param l left index of range
+     * @param r right index of range
+     * @param mode determine pivot chosen position, ninther as default
+     * @return long counted comparison times
+     */
+    long ParallelSort (std::vector<int>& v, int l, int r, pivot_mode mode = ninther) {
+        if (r <= l) return 0;
+        if (ThreadPool::Instance().Size() < 2) return IntroSort(v, l, r, mode, block);
+        if (r - l + 1 >= sample_sort_cutoff) return SampleSort(v, l, r, mode);
+        std::atomic<long> count(0);
+        {
+            TaskGroup group;
+            ParallelLoop(v, l, r, mode, 2 * (int)std::log2(r - l + 1), true, group, count);
+            group.Wait();
+        }
+        return count;
+    }
+    /**
+     * @brief parallel sample sort. Splitters picked from a sorted random sample divide the range
+     * into one bucket per task, blocks of the input are classified and scattered into a buffer
+     * in parallel, then every bucket is sorted independently by IntroSort.
+     * 
+     * @param v input vector, duplicates allowed
+     * @param l left index of range
+     * @param r right index of range
+     * @param mode determine pivot chosen position for sorting buckets
+     * @return long counted comparison times
+     */
+    long SampleSort (std::vector<int>& v, int l, int r, pivot_mode mode = ninther) {
+        const long n = r - l + 1;
+        const int k = std::min(256, 4 * (ThreadPool::Instance().Size() + 1)); // bucket number
+        const int oversample = 32;
+        if (n < (long)k * oversample * 4) return IntroSort(v, l, r, mode, block);
+        // pick k - 1 splitters from the sorted sample
+        std::vector<int> sample(k * oversample);
+        for (auto& x:sample) x = v[l + std::uniform_int_distribution<long>(0, n - 1)(this->rng)];
+        std::sort(sample.begin(), sample.end());
+        std::vector<int> splitters(k - 1);
+        for (int i = 1; i < k; ++i) splitters[i - 1] = sample[i * oversample];
+        const int log_k = (int)std::ceil(std::log2(k));
+        // the same number of blocks as buckets, classified in parallel
+        const int blocks = k;
+        const long block_size = (n + blocks - 1) / blocks;
+        std::vector<unsigned char> bucket(n);
+        std::vector<long> histogram((long)blocks * k, 0); // [block][bucket]
+        std::atomic<long> count(n * log_k);
+        int* src = v.data() + l;
+        {
+            TaskGroup group;
+            for (int b = 0; b < blocks; ++b) {
+                group.Run([&, b] {
+                    long begin = b * block_size, end = std::min(n, begin + block_size);
+                    long* h = histogram.data() + (long)b * k;
+                    for (long i = begin; i < end; ++i) {
+                        // elements equal to a splitter go right
+                        int idx = std::upper_bound(splitters.begin(), splitters.end(), src[i]) - splitters.begin();
+                        bucket[i] = idx;
+                        ++h[idx];
+                    }
+                });
+            }
+        }
+        // exclusive prefix sum in bucket major order gives the scatter offset of each block
+        std::vector<long> offset((long)blocks * k);
+        std::vector<long> bucket_begin(k + 1, 0);
+        long sum = 0;
+        for (int i = 0; i < k; ++i) {
+            bucket_begin[i] = sum;
+            for (int b = 0; b < blocks; ++b) {
+                offset[(long)b * k + i] = sum;
+                sum += histogram[(long)b * k + i];
+            }
+        }
+        bucket_begin[k] = n;
+        std::vector<int> buffer(n);
+        {
+            TaskGroup group;
+            for (int b = 0; b < blocks; ++b) {
+                group.Run([&, b] {
+                    long begin = b * block_size, end = std::min(n, begin + block_size);
+                    long* o = offset.data() + (long)b * k;
+                    for (long i = begin; i < end; ++i) buffer[o[bucket[i]]++] = src[i];
+                });
+            }
+        }
+        {
+            TaskGroup group;
+            for (int i = 0; i < k; ++i) {
+                group.Run([&, i] {
+                    long begin = bucket_begin[i], end = bucket_begin[i + 1];
+                    QuickSort sorter(i);
+                    long c = (end - begin > 1) ? sorter.IntroSort(buffer, begin, end - 1, mode, block) : 0;
+                    std::copy(buffer.begin() + begin, buffer.begin() + end, src + begin);
+                    count += c;
+                });
+            }
+        }
+        return count;
+    }
+    /**
+     * @brief print ns/element of std::sort, IntroSort with each partition scheme and ParallelSort
+     * on uniformly random int vectors of size 1e3, 1e4, ... up to max_size
+     * 
+     * @param max_size the largest vector size
+     */
+    void Benchmark (long max_size = 100000000) {
+        std::mt19937 gen(2022);
+        std::cout << "size\tstd::sort\tthree_way\tblock\tsimd(level " << SimdLevel() << ")\n";
+        for (long n = 1000; n <= max_size; n *= 10) {
+            std::vector<int> input(n);
+            for (auto& x:input) x = (int)gen();
+            // repeat small sizes so that every measurement covers about 1e7 elements
+            long rounds = std::max(1L, 10000000L / n);
+            std::vector<int> v;
+            auto measure = [&](auto sort) {
+                double total = 0;
+                for (long i = 0; i < rounds; ++i) {
+                    v = input;
+                    auto begin = std::chrono::steady_clock::now();
+                    sort();
+                    auto end = std::chrono::steady_clock::now();
+                    total += std::chrono::duration<double, std::nano>(end - begin).count();
+                }
+                if (!std::is_sorted(v.begin(), v.end())) std::cout << "error: not sorted!\n";
+                return total / (rounds * n);
+            };
+            std::cout << n << "\t" << measure([&]{ std::sort(v.begin(), v.end()); });
+            std::cout << "\t" << measure([&]{ IntroSort(v, 0, n - 1, ninther, three_way); });
+            std::cout << "\t" << measure([&]{ IntroSort(v, 0, n - 1, ninther, block); });
+            std::cout << "\t" << measure([&]{ IntroSort(v, 0, n - 1, ninther, simd); });
+            std::cout << "\t" << measure([&]{ ParallelSort(v, 0, n - 1, ninther); }) << "\n";
+        }
+    }
+private:
+    std::vector<int> scratch; // buffer of the vectorized partition
+    long IntroSortLoop (std::vector<int>& v, int l, int r, pivot_mode mode, int depth_limit) {
+        long count = 0;
+        while (r - l + 1 > insertion_cutoff) {
+            if (depth_limit == 0) return count + HeapSort(v, l, r);
+            --depth_limit;
+            int lt, gt;
+            count += Partition3(v, l, r, PickPivot(v, l, r, mode), lt, gt);
+            // recurse on the smaller side and loop on the larger one
+            if (lt - l < r - gt) {
+                count += IntroSortLoop(v, l, lt - 1, mode, depth_limit);
+                l = gt + 1;
+            } else {
+                count += IntroSortLoop(v, gt + 1, r, mode, depth_limit);
+                r = lt - 1;
+            }
+        }
+        return count + InsertionSort(v, l, r);
+    }
+    /**
+     * @brief one partition step of the 2-way schemes on [l, r]. v[l-1] is a former pivot, no larger 
+     * than any element of the range. if it equals the pivot, all the copies of the pivot are 
+     * the minimum and already in place, so they are only put aside by moving l.
+     * 
+     * @return int index of the pivot after partition, or -1 if copies of the pivot were put aside
+     */
+    int PartitionStep (std::vector<int>& v, int& l, int r, pivot_mode mode, partition_scheme scheme, bool leftmost) {
+        std::swap(v[l], v[PickPivot(v, l, r, mode)]);
+        const int p = v[l];
+        int* first = v.data() + l + 1;
+        int* last = v.data() + r + 1;
+        if (!leftmost && !(v[l-1] < p)) {
+            l = (p == INT_MAX) ? r + 1 : PartitionBy(first, last, p + 1, scheme) - v.data();
+            return -1;
+        }
+        int m = PartitionBy(first, last, p, scheme) - v.data() - 1;
+        std::swap(v[l], v[m]);
+        return m;
+    }
+    // 2-way partition variant, leftmost tells whether v[l-1] is outside of the sorted range
+    long IntroSortLoop (std::vector<int>& v, int l, int r, pivot_mode mode, partition_scheme scheme, int depth_limit, bool leftmost) {
+        long count = 0;
+        while (r - l + 1 > insertion_cutoff) {
+            if (depth_limit == 0) return count + HeapSort(v, l, r);
+            --depth_limit;
+            count += r - l;
+            int m = PartitionStep(v, l, r, mode, scheme, leftmost);
+            if (m < 0) continue;
+            // recurse on the smaller side and loop on the larger one
+            if (m - l < r - m) {
+                count += IntroSortLoop(v, l, m - 1, mode, scheme, depth_limit, leftmost);
+                l = m + 1;
+                leftmost = false;
+            } else {
+                count += IntroSortLoop(v, m + 1, r, mode, scheme, depth_limit, false);
+                r = m - 1;
+            }
+        }
+        return count + InsertionSort(v, l, r);
+    }
+    // fork the smaller side of each partition onto the pool while the range is large
+    void ParallelLoop (std::vector<int>& v, int l, int r, pivot_mode mode, int depth_limit, bool leftmost,
+                        TaskGroup& group, std::atomic<long>& count) {
+        long local = 0;
+        while (r - l + 1 > parallel_cutoff && depth_limit > 0) {
+            --depth_limit;
+            local += r - l;
+            int m = PartitionStep(v, l, r, mode, block, leftmost);
+            if (m < 0) continue;
+            // every task owns a sorter, the random generator is not shared between threads
+            int fl, fr;
+            bool fleftmost;
+            if (m - l < r - m) {
+                fl = l, fr = m - 1, fleftmost = leftmost;
+                l = m + 1;
+                leftmost = false;
+            } else {
+                fl = m + 1, fr = r, fleftmost = false;
+                r = m - 1;
+            }
+            // a side of at most one element is already sorted
+            if (fl >= fr) continue;
+            group.Run([&v, fl, fr, mode, depth_limit, fleftmost, &group, &count] {
+                QuickSort sorter((unsigned)fl * 2654435761u ^ (unsigned)fr);
+                sorter.ParallelLoop(v, fl, fr, mode, depth_limit, fleftmost, group, count);
+            });
+        }
+        if (r > l) local += IntroSortLoop(v, l, r, mode, block, depth_limit, leftmost);
+        count += local;
+    }
 };
 # endif /* QUICK_SORT_H_ */
\ No newline at end of file
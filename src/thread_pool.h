@@ -0,0 +1,191 @@
+# ifndef THREAD_POOL_H_
+# define THREAD_POOL_H_
+# include <vector>
+# include <deque>
+# include <thread>
+# include <mutex>
+# include <condition_variable>
+# include <atomic>
+# include <functional>
+# include <memory>
+# include <exception>
+/**
+ * @brief work stealing thread pool for fork-join parallelism. Each worker owns a deque,
+ * tasks forked by a worker are pushed to its own deque and popped LIFO, idle workers
+ * steal FIFO from the others. Tasks submitted from outside the pool go to one shared queue.
+ * Threads waiting for a TaskGroup run pending tasks, and sleep only when there is nothing to
+ * run, so nested forks never deadlock and waiting does not burn a core.
+ * example:
+ * int main ()
+{
+    std::atomic<long> sum(0);
+    TaskGroup group;
+    for (int i = 0; i < 100; ++i) group.Run([&sum, i]{ sum += i; });
+    group.Wait();
+    std::cout << sum << "\n";
+    return 0;
+}
+ */
+class ThreadPool {
+private:
+    typedef std::function<void()> Task;
+    struct Queue {
+        std::mutex lock;
+        std::deque<Task> tasks;
+    };
+    std::vector<std::unique_ptr<Queue>> queues; // one per worker, the last one for external threads
+    std::vector<std::thread> workers;
+    std::mutex sleep_lock;
+    std::condition_variable wake;
+    std::atomic<long> pending;
+    bool stop;
+    // index of the queue owned by calling thread, or -1 for threads outside the pool
+    static int& WorkerId() {
+        static thread_local int id = -1;
+        return id;
+    }
+    bool PopLocal(int id, Task& task) {
+        auto& q = *this->queues[id];
+        std::lock_guard<std::mutex> guard(q.lock);
+        if (q.tasks.empty()) return false;
+        task = std::move(q.tasks.back());
+        q.tasks.pop_back();
+        return true;
+    }
+    bool Steal(int id, Task& task) {
+        int n = this->queues.size();
+        for (int i = 1; i <= n; ++i) {
+            auto& q = *this->queues[(id + i) % n];
+            std::lock_guard<std::mutex> guard(q.lock);
+            if (q.tasks.empty()) continue;
+            task = std::move(q.tasks.front());
+            q.tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+    void Loop(int id) {
+        WorkerId() = id;
+        while (true) {
+            if (RunPending()) continue;
+            std::unique_lock<std::mutex> guard(this->sleep_lock);
+            this->wake.wait(guard, [this]{ return this->stop || this->pending > 0; });
+            if (this->stop && this->pending == 0) return;
+        }
+    }
+public:
+    /**
+     * @brief Construct a new Thread Pool object
+     *
+     * @param n number of worker threads, hardware concurrency as default
+     */
+    ThreadPool (unsigned n = std::thread::hardware_concurrency()) : pending(0), stop(false) {
+        if (n == 0) n = 1;
+        for (unsigned i = 0; i <= n; ++i) this->queues.emplace_back(new Queue);
+        for (unsigned i = 0; i < n; ++i) this->workers.emplace_back(&ThreadPool::Loop, this, i);
+    }
+    ~ThreadPool () {
+        {
+            std::lock_guard<std::mutex> guard(this->sleep_lock);
+            this->stop = true;
+        }
+        this->wake.notify_all();
+        for (auto& t:this->workers) t.join();
+    }
+    // the pool shared by all parallel algorithms
+    static ThreadPool& Instance () {
+        static ThreadPool pool;
+        return pool;
+    }
+    int Size () { return this->workers.size(); }
+    void Submit (Task task) {
+        int id = WorkerId();
+        if (id < 0) id = this->queues.size() - 1;
+        {
+            std::lock_guard<std::mutex> guard(this->queues[id]->lock);
+            this->queues[id]->tasks.emplace_back(std::move(task));
+        }
+        {
+            std::lock_guard<std::mutex> guard(this->sleep_lock);
+            ++this->pending;
+        }
+        this->wake.notify_one();
+    }
+    /**
+     * @brief run one pending task on the calling thread, local tasks first
+     *
+     * @return true if a task was run
+     */
+    bool RunPending () {
+        int id = WorkerId();
+        Task task;
+        if ((id >= 0 && PopLocal(id, task)) || Steal(id < 0 ? 0 : id, task)) {
+            --this->pending;
+            task();
+            return true;
+        }
+        return false;
+    }
+    /**
+     * @brief block the calling thread until done() holds, a task is pending or the pool stops.
+     * done() is checked under the sleep lock, pair it with Notify() after making it true.
+     *
+     */
+    template <class Predicate>
+    void Sleep (Predicate done) {
+        std::unique_lock<std::mutex> guard(this->sleep_lock);
+        this->wake.wait(guard, [&]{ return done() || this->pending > 0 || this->stop; });
+    }
+    // wake every sleeping thread to check its condition again
+    void Notify () {
+        {
+            std::lock_guard<std::mutex> guard(this->sleep_lock);
+        }
+        this->wake.notify_all();
+    }
+};
+/**
+ * @brief a set of forked tasks that can be joined by Wait(). The first exception thrown by a
+ * task is rethrown by Wait(), the destructor joins the tasks without rethrowing.
+ *
+ */
+class TaskGroup {
+private:
+    ThreadPool& pool;
+    std::atomic<int> count;
+    std::mutex error_lock;
+    std::exception_ptr error;
+    // help running tasks until all tasks of this group finished, sleep when nothing can be run
+    void Join () {
+        while (this->count > 0) {
+            if (!this->pool.RunPending()) this->pool.Sleep([this]{ return this->count == 0; });
+        }
+    }
+public:
+    TaskGroup (ThreadPool& pool = ThreadPool::Instance()) : pool(pool), count(0) {}
+    ~TaskGroup () { Join(); }
+    template <class F>
+    void Run (F f) {
+        ++this->count;
+        this->pool.Submit([this, f]() mutable {
+            try {
+                f();
+            } catch (...) {
+                std::lock_guard<std::mutex> guard(this->error_lock);
+                if (!this->error) this->error = std::current_exception();
+            }
+            // the group may be gone once count reaches 0, keep the pool
+            ThreadPool& pool = this->pool;
+            if (--this->count == 0) pool.Notify();
+        });
+    }
+    void Wait () {
+        Join();
+        if (this->error) {
+            std::exception_ptr e = this->error;
+            this->error = nullptr;
+            std::rethrow_exception(e);
+        }
+    }
+};
+# endif /* THREAD_POOL_H_ */
@@ -1,7 +1,13 @@
 # ifndef TSP_H_
 # define TSP_H_
 # include <math.h>
+# include <limits>
+# include <algorithm>
 # include "util.h"
+# include "thread_pool.h"
+# if defined(__x86_64__) && defined(__GNUC__)
+# include <immintrin.h>
+# endif
 
 struct Point {
     float x;
@@ -18,6 +24,10 @@ struct Point {
     if (!ReadData("../data/_f702b2a7b43c0d64707f7ab1b4394754_tsp.txt", true, test))
         std::cout << "fail reading data!\n";
     std::cout << test.MinimumCost() << "\n";
+    auto c = test.FillDistMatrix(test.Points());
+    std::vector<int> tour;
+    std::cout << test.BranchAndBound(c, &tour) << "\n";
+    print(tour);
     return 0;
 }
  * reference: 
@@ -33,6 +43,7 @@ private:
 public:
     TravelingSalesmanProblem (float f):inf(f){}
     TravelingSalesmanProblem ():inf(1000000.0){}
+    std::vector<Point>& Points () { return this->points; }
     void ProcessHeader (std::string& line) {
         this->size = std::stoi(line);
     }
@@ -117,9 +128,381 @@ public:
         return ans;
     }
 
+    /**
+     * @brief Held-Karp on a flat table. The start city 0 is in every subset, so the table is
+     * indexed only by subsets S of cities 1..n-1, which halves the memory of DP_TSP. Entries are
+     * pulled in increasing order of S, dp[S][j] = min over k of dp[S - {j}][k] + c[k][j]. Entries
+     * with k outside S - {j} hold infinity, so the min runs over a whole contiguous row and is
+     * vectorized.
+     * 
+     * @param c distance matrix
+     * @param tour if not null, receives an optimal tour as city indices starting from city 0
+     * @return float minimum tour cost
+     */
+    float HeldKarp (std::vector<std::vector<float>>& c, std::vector<int>* tour = nullptr) {
+        const int m = this->size - 1; // cities 1..n-1 are bits 0..m-1
+        if (m <= 0) {
+            if (tour) tour->assign(this->size, 0);
+            return 0;
+        }
+        const int stride = (m + 7) / 8 * 8; // rows padded to whole vectors of 8 floats
+        const float infinity = std::numeric_limits<float>::infinity();
+        // to[j][k] is the distance from city k+1 into city j+1
+        std::vector<float> to((size_t)m * stride, infinity);
+        for (int j = 0; j < m; ++j) {
+            for (int k = 0; k < m; ++k) if (k != j) to[(size_t)j * stride + k] = c[k + 1][j + 1];
+        }
+        const size_t subsets = (size_t)1 << m;
+        std::vector<float> dp(subsets * stride, infinity);
+        // base case: the path from city 0 straight into j
+        for (int j = 0; j < m; ++j) dp[((size_t)1 << j) * stride + j] = c[0][j + 1];
+        for (size_t s = 1; s < subsets; ++s) {
+            if (!(s & (s - 1))) continue;
+            float* row = &dp[s * stride];
+            for (size_t rest = s; rest; rest &= rest - 1) {
+                int j = __builtin_ctzll(rest);
+                row[j] = MinPlus(&dp[(s ^ ((size_t)1 << j)) * stride], &to[(size_t)j * stride], stride);
+            }
+        }
+        // cost of final hop of tour
+        float ans = infinity;
+        int last = 0;
+        for (int j = 0; j < m; ++j) {
+            if (dp[(subsets - 1) * stride + j] + c[j + 1][0] < ans) {
+                ans = dp[(subsets - 1) * stride + j] + c[j + 1][0];
+                last = j;
+            }
+        }
+        if (tour) {
+            // walk back through the predecessor reaching each entry with its minimum
+            tour->assign(this->size, 0);
+            size_t s = subsets - 1;
+            for (int pos = m; pos >= 1; --pos) {
+                (*tour)[pos] = last + 1;
+                size_t prev = s ^ ((size_t)1 << last);
+                if (!prev) break;
+                const float* row = &dp[prev * stride];
+                int best = -1;
+                for (size_t rest = prev; rest; rest &= rest - 1) {
+                    int k = __builtin_ctzll(rest);
+                    if (best < 0 || row[k] + to[(size_t)last * stride + k] < row[best] + to[(size_t)last * stride + best]) best = k;
+                }
+                s = prev;
+                last = best;
+            }
+        }
+        return ans;
+    }
+
+    /**
+     * @brief HeldKarp() by layers of subset size. Subsets of size k only pull from size k-1, so each
+     * layer is split into rank ranges run on the thread pool, joined before the next layer. Only two
+     * layers are resident: a subset is stored at its colex rank within its layer, enumerated by 
+     * Gosper's hack from the unranked start of each range. n = 25 needs about 0.5 GB instead of 1.6 GB.
+     * 
+     * @param c distance matrix
+     * @return float minimum tour cost
+     */
+    float HeldKarpParallel (std::vector<std::vector<float>>& c) {
+        const int m = this->size - 1;
+        if (m <= 0) return 0;
+        const int stride = (m + 7) / 8 * 8;
+        const float infinity = std::numeric_limits<float>::infinity();
+        std::vector<float> to((size_t)m * stride, infinity);
+        for (int j = 0; j < m; ++j) {
+            for (int k = 0; k < m; ++k) if (k != j) to[(size_t)j * stride + k] = c[k + 1][j + 1];
+        }
+        // binomial[a][b] = a choose b
+        std::vector<std::vector<size_t>> binomial(m + 1, std::vector<size_t>(m + 2, 0));
+        for (int a = 0; a <= m; ++a) {
+            binomial[a][0] = 1;
+            for (int b = 1; b <= a; ++b) binomial[a][b] = binomial[a - 1][b - 1] + binomial[a - 1][b];
+        }
+        size_t widest = 0;
+        for (int k = 1; k <= m; ++k) widest = std::max(widest, binomial[m][k]);
+        std::vector<float> prev(widest * stride), cur(widest * stride);
+        // layer 1, subset {j} has rank j
+        for (int j = 0; j < m; ++j) {
+            std::fill(&prev[(size_t)j * stride], &prev[(size_t)(j + 1) * stride], infinity);
+            prev[(size_t)j * stride + j] = c[0][j + 1];
+        }
+        const size_t chunks = 4 * ThreadPool::Instance().Size();
+        for (int k = 2; k <= m; ++k) {
+            const size_t count = binomial[m][k];
+            const size_t step = std::max<size_t>(1024, (count + chunks - 1) / chunks);
+            TaskGroup group;
+            for (size_t first = 0; first < count; first += step) {
+                const size_t last = std::min(count, first + step);
+                group.Run([&, k, first, last] {
+                    // unrank the first subset of the range, largest bits first
+                    size_t s = 0, r = first;
+                    for (int i = k, b = m - 1; i >= 1; --i) {
+                        while (binomial[b][i] > r) --b;
+                        r -= binomial[b][i];
+                        s |= (size_t)1 << b--;
+                    }
+                    int bits[64];
+                    size_t keep_low[64], keep_high[64];
+                    for (size_t rank = first; rank < last; ++rank) {
+                        int t = 0;
+                        for (size_t rest = s; rest; rest &= rest - 1) bits[t++] = __builtin_ctzll(rest);
+                        // rank of s - {bits[t]}: bits below t keep their position, bits above move down one
+                        keep_low[0] = 0;
+                        for (int i = 0; i < k - 1; ++i) keep_low[i + 1] = keep_low[i] + binomial[bits[i]][i + 1];
+                        keep_high[k - 1] = 0;
+                        for (int i = k - 1; i > 0; --i) keep_high[i - 1] = keep_high[i] + binomial[bits[i]][i];
+                        float* row = &cur[rank * stride];
+                        std::fill(row, row + stride, infinity);
+                        for (int i = 0; i < k; ++i) {
+                            const int j = bits[i];
+                            row[j] = MinPlus(&prev[(keep_low[i] + keep_high[i]) * stride], &to[(size_t)j * stride], stride);
+                        }
+                        // Gosper's hack, next larger integer with the same number of bits
+                        size_t low = s & (~s + 1), ripple = s + low;
+                        s = (((ripple ^ s) >> 2) / low) | ripple;
+                    }
+                });
+            }
+            group.Wait();
+            prev.swap(cur);
+        }
+        float ans = infinity;
+        for (int j = 0; j < m; ++j) ans = std::min(ans, prev[j] + c[j + 1][0]);
+        return ans;
+    }
+
+    /**
+     * @brief exact TSP by depth first branch and bound, in memory O(n^2).
+     * the upper bound starts from a nearest neighbor tour improved by 2-opt. A partial path from
+     * city 0 to last is completed by a path through the unvisited cities R, which costs at least the
+     * spanning tree of R plus the cheapest links of R to both ends. Adding penalties pi[r] to the
+     * edges of each r in R raises every completion by 2 * sum(pi), so the bound is tightened by
+     * subgradient ascent on pi (Held-Karp), long at the root and warm started from the parent below.
+     * 
+     * @param c distance matrix
+     * @param tour if not null, receives an optimal tour as city indices starting from city 0
+     * @return float minimum tour cost
+     */
+    float BranchAndBound (std::vector<std::vector<float>>& c, std::vector<int>* tour = nullptr) {
+        const int n = this->size;
+        Search search;
+        search.n = n;
+        search.c.assign((size_t)n * n, 0);
+        for (int i = 0; i < n; ++i) {
+            for (int j = 0; j < n; ++j) search.c[(size_t)i * n + j] = c[i][j];
+        }
+        search.best_tour = NearestNeighborTwoOpt(search);
+        search.best = TourCost(search, search.best_tour);
+        if (n > 3) {
+            search.path.assign(1, 0);
+            search.visited.assign(n, 0);
+            search.visited[0] = 1;
+            search.pi.assign(n, std::vector<double>(n, 0));
+            Branch(search, 0, 0);
+        }
+        if (tour) *tour = search.best_tour;
+        return search.best;
+    }
+
     auto MinimumCost() {
         auto c = FillDistMatrix(this->points);
-        return DP_TSP(c);
+        return HeldKarp(c);
+    }
+private:
+    // state of BranchAndBound(), costs are flat row major and in double precision
+    struct Search {
+        int n;
+        std::vector<double> c;
+        double best;
+        std::vector<int> best_tour;
+        std::vector<int> path;
+        std::vector<char> visited;
+        std::vector<std::vector<double>> pi; // penalties of each search depth
+        // buffers of the spanning tree
+        std::vector<int> nodes, parent, degree;
+        std::vector<double> key;
+    };
+    static double TourCost (Search& search, std::vector<int>& tour) {
+        double cost = 0;
+        for (int i = 0; i < search.n; ++i) cost += search.c[(size_t)tour[i] * search.n + tour[(i + 1) % search.n]];
+        return cost;
+    }
+    // nearest neighbor tour from city 0, then 2-opt until no improving move
+    static std::vector<int> NearestNeighborTwoOpt (Search& search) {
+        const int n = search.n;
+        auto c = [&search, n](int i, int j) { return search.c[(size_t)i * n + j]; };
+        std::vector<int> tour(1, 0);
+        std::vector<char> used(n, 0);
+        used[0] = 1;
+        for (int i = 1; i < n; ++i) {
+            int next = -1;
+            for (int j = 0; j < n; ++j) {
+                if (!used[j] && (next < 0 || c(tour.back(), j) < c(tour.back(), next))) next = j;
+            }
+            used[next] = 1;
+            tour.emplace_back(next);
+        }
+        bool improved = n > 3;
+        while (improved) {
+            improved = false;
+            for (int i = 0; i + 2 < n; ++i) {
+                for (int j = i + 2; j < n; ++j) {
+                    int a = tour[i], b = tour[i + 1], d = tour[j], e = tour[(j + 1) % n];
+                    if (a == e) continue;
+                    if (c(a, d) + c(b, e) < c(a, b) + c(d, e) - 1e-9) {
+                        std::reverse(tour.begin() + i + 1, tour.begin() + j + 1);
+                        improved = true;
+                    }
+                }
+            }
+        }
+        return tour;
+    }
+    /**
+     * @brief lower bound of completing the path ending at last, minus the cost of the path. The 
+     * completion is a spanning tree of the unvisited cities linked once to last and once to city 0,
+     * through a city larger than second if second >= 0. pi is improved in place for the children.
+     * 
+     * @param limit stop as soon as the bound reaches limit
+     * @param iterations subgradient steps
+     */
+    static double RestBound (Search& search, int last, int second, std::vector<double>& pi, double limit, int iterations) {
+        const int n = search.n;
+        auto& nodes = search.nodes;
+        nodes.clear();
+        for (int i = 0; i < n; ++i) if (!search.visited[i]) nodes.emplace_back(i);
+        const int k = nodes.size();
+        auto& key = search.key;
+        auto& parent = search.parent;
+        auto& degree = search.degree;
+        key.resize(k);
+        parent.resize(k);
+        degree.resize(k);
+        double bound = -std::numeric_limits<double>::infinity();
+        for (int iteration = 0; iteration < iterations; ++iteration) {
+            // Prim's algorithm under the costs c[u][v] + pi[u] + pi[v]
+            double total = 0, pi_sum = 0;
+            for (int i = 0; i < k; ++i) {
+                key[i] = std::numeric_limits<double>::infinity();
+                parent[i] = -1;
+                degree[i] = 0;
+                pi_sum += pi[nodes[i]];
+            }
+            key[0] = 0;
+            for (int step = 0; step < k; ++step) {
+                int u = -1;
+                for (int i = step; i < k; ++i) if (u < 0 || key[i] < key[u]) u = i;
+                // move the new tree node to position step, the rest of the array is still outside
+                std::swap(nodes[u], nodes[step]);
+                std::swap(key[u], key[step]);
+                std::swap(parent[u], parent[step]);
+                u = step;
+                total += key[u];
+                if (parent[u] >= 0) {
+                    ++degree[u];
+                    ++degree[parent[u]];
+                }
+                const double* row = &search.c[(size_t)nodes[u] * n];
+                const double pu = pi[nodes[u]];
+                for (int i = step + 1; i < k; ++i) {
+                    double e = row[nodes[i]] + pu + pi[nodes[i]];
+                    if (e < key[i]) {
+                        key[i] = e;
+                        parent[i] = u;
+                    }
+                }
+            }
+            // links to both ends of the path
+            int to_last = -1, to_start = -1;
+            for (int i = 0; i < k; ++i) {
+                const int r = nodes[i];
+                if (to_last < 0 || search.c[(size_t)last * n + r] + pi[r] < search.c[(size_t)last * n + nodes[to_last]] + pi[nodes[to_last]]) to_last = i;
+                if (r > second && (to_start < 0 || search.c[r] + pi[r] < search.c[nodes[to_start]] + pi[nodes[to_start]])) to_start = i;
+            }
+            if (to_start < 0) return std::numeric_limits<double>::infinity();
+            ++degree[to_last];
+            ++degree[to_start];
+            double value = total + search.c[(size_t)last * n + nodes[to_last]] + search.c[nodes[to_start]] + pi[nodes[to_last]] + pi[nodes[to_start]] - 2 * pi_sum;
+            bound = std::max(bound, value);
+            if (bound >= limit) break;
+            // Polyak step towards the limit along degree - 2
+            long norm = 0;
+            for (int i = 0; i < k; ++i) norm += (degree[i] - 2) * (degree[i] - 2);
+            if (norm == 0) break; // the completion is a path, the bound is exact
+            double step = (limit - value) / norm;
+            for (int i = 0; i < k; ++i) pi[nodes[i]] += step * (degree[i] - 2);
+        }
+        return bound;
+    }
+    // extend the partial path ending at last with original cost
+    static void Branch (Search& search, int last, double cost) {
+        const int n = search.n;
+        const int depth = search.path.size();
+        const double* row = &search.c[(size_t)last * n];
+        if (depth == n) {
+            if (last < search.path[1]) return;
+            if (cost + row[0] < search.best - 1e-9) {
+                search.best = TourCost(search, search.path);
+                search.best_tour = search.path;
+            }
+            return;
+        }
+        // a tour and its reverse cost the same, so only tours closing through a city larger than
+        // the second city of the path are searched
+        const int second = depth > 1 ? search.path[1] : 0;
+        auto& pi = search.pi[depth];
+        if (depth > 1) pi = search.pi[depth - 1];
+        const double limit = search.best * (1 - 1e-9) - cost;
+        if (RestBound(search, last, second, pi, limit, depth == 1 ? 50 * n : 10) >= limit) return;
+        std::vector<int> order;
+        for (int i = 0; i < n; ++i) if (!search.visited[i]) order.emplace_back(i);
+        std::sort(order.begin(), order.end(), [row, &pi](int a, int b) { return row[a] + pi[a] < row[b] + pi[b]; });
+        for (int next:order) {
+            search.visited[next] = 1;
+            search.path.emplace_back(next);
+            Branch(search, next, cost + row[next]);
+            search.path.pop_back();
+            search.visited[next] = 0;
+        }
+    }
+    /**
+     * @brief min over k of a[k] + b[k]
+     * 
+     * @param len multiple of 8
+     */
+    static float MinPlus (const float* a, const float* b, int len) {
+# if defined(__x86_64__) && defined(__GNUC__)
+        if (HasAVX2()) return MinPlusAVX2(a, b, len);
+# endif
+        // independent lanes, so the compiler may keep them in one vector register
+        float lane[8];
+        for (int l = 0; l < 8; ++l) lane[l] = a[l] + b[l];
+        for (int k = 8; k < len; k += 8) {
+            for (int l = 0; l < 8; ++l) lane[l] = std::min(lane[l], a[k + l] + b[k + l]);
+        }
+        return *std::min_element(lane, lane + 8);
+    }
+    static bool HasAVX2 () {
+# if defined(__x86_64__) && defined(__GNUC__)
+        static const bool avx2 = __builtin_cpu_supports("avx2");
+        return avx2;
+# else
+        return false;
+# endif
+    }
+# if defined(__x86_64__) && defined(__GNUC__)
+    __attribute__((target("avx2")))
+    static float MinPlusAVX2 (const float* a, const float* b, int len) {
+        __m256 acc = _mm256_add_ps(_mm256_loadu_ps(a), _mm256_loadu_ps(b));
+        for (int k = 8; k < len; k += 8) {
+            acc = _mm256_min_ps(acc, _mm256_add_ps(_mm256_loadu_ps(a + k), _mm256_loadu_ps(b + k)));
+        }
+        // horizontal min of 8 lanes
+        __m128 low = _mm_min_ps(_mm256_castps256_ps128(acc), _mm256_extractf128_ps(acc, 1));
+        low = _mm_min_ps(low, _mm_movehl_ps(low, low));
+        low = _mm_min_ss(low, _mm_shuffle_ps(low, low, 1));
+        return _mm_cvtss_f32(low);
     }
+# endif
 };
 # endif /* TSP_H_ */
\ No newline at end of file
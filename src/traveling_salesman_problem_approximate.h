@@ -3,6 +3,11 @@
 # include "util.h"
 # include <math.h>
 # include <queue>
+# include <algorithm>
+# include <chrono>
+# include <mutex>
+# include <numeric>
+# include "thread_pool.h"
 struct Point {
     int idx;
     double x;
@@ -33,6 +38,235 @@ public:
         return (lhs.second < rhs.second);
   }
 };
+/**
+ * @brief uniform grid over a set of points for nearest remaining point queries. Cells hold about 
+ * two points, a query scans rings of cells around the source until the nearest point found is 
+ * closer than anything beyond the ring. Removed points are swapped out of their cell, and the grid
+ * is rebuilt coarser whenever the remaining points fall below a quarter of the cells, so queries
+ * near the end of a tour do not scan a mostly empty grid.
+ * 
+ */
+class PointGrid {
+private:
+    std::vector<Point>* points;
+    std::vector<int> remaining; // positions in points not removed yet
+    std::vector<int> slot; // slot[i] is the place of point i in remaining, -1 if removed
+    std::vector<int> cell_of; // cell of each remaining point
+    std::vector<std::vector<int>> cells;
+    std::vector<int> place; // place of each point inside its cell
+    double x0, y0, width;
+    int columns, rows;
+    int Column (double x) { return std::min(this->columns - 1, std::max(0, (int)((x - this->x0) / this->width))); }
+    int Row (double y) { return std::min(this->rows - 1, std::max(0, (int)((y - this->y0) / this->width))); }
+    void Build () {
+        const int n = std::max<int>(1, this->remaining.size());
+        double x1 = this->x0 = (*this->points)[this->remaining.empty() ? 0 : this->remaining[0]].x;
+        double y1 = this->y0 = (*this->points)[this->remaining.empty() ? 0 : this->remaining[0]].y;
+        for (int i:this->remaining) {
+            auto& p = (*this->points)[i];
+            this->x0 = std::min(this->x0, p.x);
+            this->y0 = std::min(this->y0, p.y);
+            x1 = std::max(x1, p.x);
+            y1 = std::max(y1, p.y);
+        }
+        // square cells, about 2 points per cell
+        double area = std::max((x1 - this->x0) * (y1 - this->y0), 1e-12);
+        this->width = std::max(sqrt(2.0 * area / n), std::max(x1 - this->x0, y1 - this->y0) / n);
+        if (this->width <= 0) this->width = 1;
+        this->columns = (int)((x1 - this->x0) / this->width) + 1;
+        this->rows = (int)((y1 - this->y0) / this->width) + 1;
+        this->cells.assign((size_t)this->columns * this->rows, std::vector<int>());
+        for (int i:this->remaining) {
+            auto& p = (*this->points)[i];
+            int c = Row(p.y) * this->columns + Column(p.x);
+            this->cell_of[i] = c;
+            this->place[i] = this->cells[c].size();
+            this->cells[c].emplace_back(i);
+        }
+    }
+public:
+    /**
+     * @brief Construct a new Point Grid object over the first n points
+     * 
+     */
+    PointGrid (std::vector<Point>& points, int n) : points(&points), slot(n), cell_of(n), place(n) {
+        for (int i = 0; i < n; ++i) {
+            this->slot[i] = i;
+            this->remaining.emplace_back(i);
+        }
+        Build();
+    }
+    int Size () { return this->remaining.size(); }
+    void Remove (int i) {
+        if (this->slot[i] < 0) return;
+        // swap remove from the cell and from the remaining list
+        auto& cell = this->cells[this->cell_of[i]];
+        int last = cell.back();
+        cell[this->place[i]] = last;
+        this->place[last] = this->place[i];
+        cell.pop_back();
+        int moved = this->remaining.back();
+        this->remaining[this->slot[i]] = moved;
+        this->slot[moved] = this->slot[i];
+        this->remaining.pop_back();
+        this->slot[i] = -1;
+        if (this->remaining.size() * 4 < this->cells.size() && this->cells.size() > 1) Build();
+    }
+    /**
+     * @brief nearest remaining point of (x, y) by squared euclidean distance, smaller position on ties
+     * 
+     * @return int position in points, -1 if no point remains
+     */
+    int Nearest (double x, double y) {
+        if (this->remaining.empty()) return -1;
+        const int cx = Column(x), cy = Row(y);
+        int best = -1;
+        double best_distance = 0;
+        for (int r = 0; ; ++r) {
+            const int left = cx - r, right = cx + r, bottom = cy - r, top = cy + r;
+            auto scan = [&](int column, int row) {
+                if (column < 0 || column >= this->columns || row < 0 || row >= this->rows) return;
+                for (int i:this->cells[(size_t)row * this->columns + column]) {
+                    auto& p = (*this->points)[i];
+                    double d = (p.x - x) * (p.x - x) + (p.y - y) * (p.y - y);
+                    if (best < 0 || d < best_distance || (d == best_distance && i < best)) {
+                        best = i;
+                        best_distance = d;
+                    }
+                }
+            };
+            if (r == 0) scan(cx, cy);
+            else {
+                for (int column = left; column <= right; ++column) {
+                    scan(column, bottom);
+                    scan(column, top);
+                }
+                for (int row = bottom + 1; row < top; ++row) {
+                    scan(left, row);
+                    scan(right, row);
+                }
+            }
+            if (left <= 0 && bottom <= 0 && right >= this->columns - 1 && top >= this->rows - 1) break;
+            if (best >= 0) {
+                // every point outside the rings scanned so far is at least this far
+                double gap = std::min(std::min(x - (this->x0 + left * this->width), this->x0 + (right + 1) * this->width - x),
+                    std::min(y - (this->y0 + bottom * this->width), this->y0 + (top + 1) * this->width - y));
+                if (gap > 0 && best_distance < gap * gap) break;
+            }
+        }
+        return best;
+    }
+    /**
+     * @brief the k nearest remaining points of (x, y), nearest first
+     * 
+     * @param out receives at most k positions in points
+     */
+    void Nearest (double x, double y, int k, std::vector<int>& out) {
+        std::vector<std::pair<double, int>> found; // sorted by distance, at most k
+        const int cx = Column(x), cy = Row(y);
+        for (int r = 0; k > 0; ++r) {
+            const int left = cx - r, right = cx + r, bottom = cy - r, top = cy + r;
+            auto scan = [&](int column, int row) {
+                if (column < 0 || column >= this->columns || row < 0 || row >= this->rows) return;
+                for (int i:this->cells[(size_t)row * this->columns + column]) {
+                    auto& p = (*this->points)[i];
+                    std::pair<double, int> item((p.x - x) * (p.x - x) + (p.y - y) * (p.y - y), i);
+                    if ((int)found.size() == k && !(item < found.back())) continue;
+                    if ((int)found.size() == k) found.pop_back();
+                    found.insert(std::upper_bound(found.begin(), found.end(), item), item);
+                }
+            };
+            if (r == 0) scan(cx, cy);
+            else {
+                for (int column = left; column <= right; ++column) {
+                    scan(column, bottom);
+                    scan(column, top);
+                }
+                for (int row = bottom + 1; row < top; ++row) {
+                    scan(left, row);
+                    scan(right, row);
+                }
+            }
+            if (left <= 0 && bottom <= 0 && right >= this->columns - 1 && top >= this->rows - 1) break;
+            if ((int)found.size() == k) {
+                double gap = std::min(std::min(x - (this->x0 + left * this->width), this->x0 + (right + 1) * this->width - x),
+                    std::min(y - (this->y0 + bottom * this->width), this->y0 + (top + 1) * this->width - y));
+                if (gap > 0 && found.back().first < gap * gap) break;
+            }
+        }
+        out.clear();
+        for (auto& item:found) out.emplace_back(item.second);
+    }
+};
+/**
+ * @brief tour kept as an array of cities and the position of every city, so the successor and 
+ * predecessor are O(1), and a 2-opt move reverses the shorter of the two sides of the cycle.
+ * 
+ */
+class ArrayTour {
+private:
+    int n;
+    std::vector<int> order;
+    std::vector<int> pos;
+public:
+    ArrayTour (const std::vector<int>& cities) : n(cities.size()), order(cities), pos(cities.size()) {
+        for (int i = 0; i < this->n; ++i) this->pos[cities[i]] = i;
+    }
+    int Size () { return this->n; }
+    int Next (int city) { return this->order[this->pos[city] + 1 == this->n ? 0 : this->pos[city] + 1]; }
+    int Prev (int city) { return this->order[this->pos[city] == 0 ? this->n - 1 : this->pos[city] - 1]; }
+    // number of cities from a to b following the tour, both included
+    int Span (int a, int b) { return (this->pos[b] - this->pos[a] + this->n) % this->n + 1; }
+    const std::vector<int>& Order () { return this->order; }
+    /**
+     * @brief reverse len cities from position i forward, cyclically
+     * 
+     */
+    void ReverseAt (int i, int len) {
+        int j = (i + len - 1) % this->n;
+        for (int k = 0; k < len / 2; ++k) {
+            std::swap(this->order[i], this->order[j]);
+            this->pos[this->order[i]] = i;
+            this->pos[this->order[j]] = j;
+            i = i + 1 == this->n ? 0 : i + 1;
+            j = j == 0 ? this->n - 1 : j - 1;
+        }
+    }
+    /**
+     * @brief reverse the path from city a forward to city b. Reversing the rest of the cycle gives
+     * the same cycle, so the shorter side is reversed.
+     * 
+     */
+    void Reverse (int a, int b) {
+        int len = Span(a, b);
+        if (2 * len > this->n) ReverseAt((this->pos[b] + 1) % this->n, this->n - len);
+        else ReverseAt(this->pos[a], len);
+    }
+    /**
+     * @brief move the path s1..s2 (forward) between city x and its successor, optionally reversed.
+     * x must be outside of the path and not its predecessor. The tour S X Y, X ending at x, becomes
+     * X S Y by swapping S with X or Y with S, whichever is shorter.
+     * 
+     */
+    void Move (int s1, int s2, int x, bool reversed) {
+        const int len = Span(s1, s2);
+        const int x_len = Span(Next(s2), x);
+        const int y_len = this->n - len - x_len;
+        if (x_len <= y_len) {
+            // S X -> X S
+            int i = this->pos[s1];
+            ReverseAt(i, len + x_len);
+            ReverseAt(i, x_len);
+            if (!reversed) ReverseAt((i + x_len) % this->n, len);
+        } else {
+            // Y S -> S Y
+            int i = this->pos[Next(x)];
+            ReverseAt(i, y_len + len);
+            if (!reversed) ReverseAt(i, len);
+            ReverseAt((i + len) % this->n, y_len);
+        }
+    }
+};
 /**
  * @brief approximately solve traveling salesman problem, hopefully accept a larger input size
  * example:
@@ -43,6 +277,8 @@ public:
         std::cout << "fail reading data!\n";
     std::cout.precision(10); // keep double precision
     std::cout << test.Greedy_TSP() << "\n";
+    std::cout << test.Improved_TSP() << "\n";
+    std::cout << test.MultiStart_TSP() << "\n";
     return 0;
 }
  */
@@ -124,24 +360,286 @@ public:
      * @return double distance of result route.
      */
     double Greedy_TSP () {
-        auto src = this->points[0];
-        std::vector<bool> visit(this->size + 1, false);
+        return RouteLength(NearestNeighborRoute(1));
+    }
+    /**
+     * @brief nearest neighbor route from the start city, the nearest unvisited city is found by a
+     * PointGrid in O(1) expected per step for evenly spread cities, instead of FindNearest()
+     * 
+     * @param start index of the first city, from 1
+     * @return std::vector<int> city indices in visiting order
+     */
+    std::vector<int> NearestNeighborRoute (int start) {
+        PointGrid grid(this->points, this->size);
         std::vector<int> route;
-        visit[src.idx] = true; // index 1
-        route.emplace_back(src.idx);
-        while (route.size() < this->size) {
-            int next = FindNearest(visit, src);
-            route.emplace_back(next);
-            visit[next] = true;
-            src = this->points[next - 1];
+        int cur = start - 1;
+        while (cur >= 0) {
+            route.emplace_back(this->points[cur].idx);
+            grid.Remove(cur);
+            cur = grid.Nearest(this->points[cur].x, this->points[cur].y);
         }
+        return route;
+    }
+    /**
+     * @brief nearest neighbor route improved by LocalSearch()
+     * 
+     * @param seconds time budget of the local search
+     * @return double distance of result route.
+     */
+    double Improved_TSP (double seconds = 1.0) {
+        std::vector<int> route = NearestNeighborRoute(1);
+        return LocalSearch(route, seconds);
+    }
+    /**
+     * @brief 2-opt and Or-opt local search on a route. Moves only join a city to one of its k nearest
+     * cities, and a don't-look bit skips cities whose neighborhood did not change since they last
+     * failed to improve. Runs until no city is active or the time budget is over.
+     * 
+     * @param route city indices in visiting order, replaced by the improved route
+     * @param seconds time budget
+     * @param neighbors k of the candidate lists
+     * @return double distance of the improved route
+     */
+    double LocalSearch (std::vector<int>& route, double seconds = 1.0, int neighbors = 8) {
+        const int n = route.size();
+        if (n < 8) return RouteLength(route);
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+        // cities are positions in points, the route visits the first n of them
+        std::vector<int> cities(n);
+        for (int i = 0; i < n; ++i) cities[i] = route[i] - 1;
+        std::vector<std::vector<int>> candidate(n);
+        {
+            PointGrid grid(this->points, n);
+            std::vector<int> found;
+            for (int city = 0; city < n; ++city) {
+                grid.Nearest(this->points[city].x, this->points[city].y, neighbors + 1, found);
+                for (int other:found) if (other != city) candidate[city].emplace_back(other);
+            }
+        }
+        ArrayTour tour(cities);
+        auto d = [this](int a, int b) { return sqrt(square_distance(this->points[a], this->points[b])); };
+        // cities with the don't-look bit off
+        std::queue<int> active;
+        std::vector<char> queued(n, 1);
+        for (int city:cities) active.push(city);
+        auto wake = [&](int city) {
+            if (queued[city]) return;
+            queued[city] = 1;
+            active.push(city);
+        };
+        const double eps = 1e-9;
+        for (long steps = 1; !active.empty(); ++steps) {
+            if ((steps & 255) == 0 && std::chrono::steady_clock::now() > deadline) break;
+            const int a = active.front();
+            active.pop();
+            queued[a] = 0;
+            bool improved = false;
+            // 2-opt: replace (a, b) and (c, e) by (a, c) and (b, e), b and e on the same side of a and c
+            for (int forward = 1; forward >= 0 && !improved; --forward) {
+                const int b = forward ? tour.Next(a) : tour.Prev(a);
+                const double ab = d(a, b);
+                for (int c:candidate[a]) {
+                    const double ac = d(a, c);
+                    if (ac >= ab) break;
+                    const int e = forward ? tour.Next(c) : tour.Prev(c);
+                    if (c == b || e == a) continue;
+                    if (ab + d(c, e) - ac - d(b, e) > eps) {
+                        if (forward) tour.Reverse(b, c);
+                        else tour.Reverse(a, e);
+                        for (int city:{a, b, c, e}) wake(city);
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+            // Or-opt: move the path of 1 to 3 cities from a next to a candidate of a
+            for (int len = 1; len <= 3 && !improved; ++len) {
+                int s1 = a, s2 = a;
+                for (int k = 1; k < len; ++k) s2 = tour.Next(s2);
+                const int p = tour.Prev(s1), next = tour.Next(s2);
+                const double removed = d(p, s1) + d(s2, next) - d(p, next);
+                for (int c:candidate[a]) {
+                    const double cs = d(c, s1);
+                    if (cs >= removed) break;
+                    if (tour.Span(s1, c) <= len) continue;
+                    // between c and its successor keeping the direction, or between the predecessor
+                    // of c and c reversed, so that s1 is next to c
+                    const int after = tour.Next(c), before = tour.Prev(c);
+                    if (c != p && removed - (cs + d(s2, after) - d(c, after)) > eps) {
+                        tour.Move(s1, s2, c, false);
+                        for (int city:{p, next, s1, s2, c, after}) wake(city);
+                        improved = true;
+                        break;
+                    }
+                    if (c != next && removed - (cs + d(s2, before) - d(before, c)) > eps) {
+                        tour.Move(s1, s2, before, true);
+                        for (int city:{p, next, s1, s2, c, before}) wake(city);
+                        improved = true;
+                        break;
+                    }
+                }
+            }
+        }
+        // start from the same city as before
+        const std::vector<int>& order = tour.Order();
+        int first = std::find(order.begin(), order.end(), route[0] - 1) - order.begin();
+        for (int i = 0; i < n; ++i) route[i] = this->points[order[(first + i) % n]].idx;
+        return RouteLength(route);
+    }
+    /**
+     * @brief greedy edge construction: candidate edges to the k nearest cities are added shortest
+     * first while both ends have degree below 2 and no cycle is closed. The fragments left are 
+     * chained from each free end to the nearest free end of another fragment.
+     * 
+     * @return std::vector<int> city indices in visiting order
+     */
+    std::vector<int> GreedyEdgeRoute (int neighbors = 10) {
+        const int n = this->size;
+        std::vector<std::pair<double, std::pair<int, int>>> edges;
+        {
+            PointGrid grid(this->points, n);
+            std::vector<int> found;
+            for (int city = 0; city < n; ++city) {
+                grid.Nearest(this->points[city].x, this->points[city].y, neighbors + 1, found);
+                for (int other:found) {
+                    if (other > city) edges.emplace_back(square_distance(this->points[city], this->points[other]), std::make_pair(city, other));
+                }
+            }
+        }
+        std::sort(edges.begin(), edges.end());
+        // union find over fragments, adjacency of at most 2 per city
+        std::vector<int> root(n), degree(n, 0);
+        std::vector<std::pair<int, int>> adjacent(n, std::make_pair(-1, -1));
+        std::iota(root.begin(), root.end(), 0);
+        auto find = [&root](int x) {
+            while (root[x] != x) x = root[x] = root[root[x]];
+            return x;
+        };
+        auto link = [&](int a, int b) {
+            (degree[a]++ ? adjacent[a].second : adjacent[a].first) = b;
+            (degree[b]++ ? adjacent[b].second : adjacent[b].first) = a;
+            root[find(a)] = find(b);
+        };
+        for (auto& edge:edges) {
+            int a = edge.second.first, b = edge.second.second;
+            if (degree[a] < 2 && degree[b] < 2 && find(a) != find(b)) link(a, b);
+        }
+        // free ends of the fragments
+        PointGrid ends(this->points, n);
+        for (int city = 0; city < n; ++city) if (degree[city] == 2) ends.Remove(city);
+        std::vector<int> route;
+        int cur = 0;
+        while (degree[cur] == 2 && cur + 1 < n) ++cur;
+        while (cur >= 0) {
+            // walk the fragment from the free end cur to its other end
+            int prev = -1;
+            while (true) {
+                route.emplace_back(this->points[cur].idx);
+                ends.Remove(cur);
+                int next = adjacent[cur].first == prev ? adjacent[cur].second : adjacent[cur].first;
+                if (next < 0 || (prev >= 0 && degree[cur] < 2)) break;
+                prev = cur;
+                cur = next;
+            }
+            cur = ends.Nearest(this->points[cur].x, this->points[cur].y);
+        }
+        return route;
+    }
+    /**
+     * @brief visit the cities in the order of a Hilbert curve over their bounding box
+     * 
+     * @return std::vector<int> city indices in visiting order
+     */
+    std::vector<int> SpaceFillingCurveRoute () {
+        const int n = this->size;
+        double x0 = this->points[0].x, y0 = this->points[0].y, x1 = x0, y1 = y0;
+        for (int i = 0; i < n; ++i) {
+            x0 = std::min(x0, this->points[i].x);
+            y0 = std::min(y0, this->points[i].y);
+            x1 = std::max(x1, this->points[i].x);
+            y1 = std::max(y1, this->points[i].y);
+        }
+        const double scale = 65535.0 / std::max(std::max(x1 - x0, y1 - y0), 1e-12);
+        std::vector<std::pair<unsigned long, int>> curve(n);
+        for (int i = 0; i < n; ++i) {
+            unsigned x = (unsigned)((this->points[i].x - x0) * scale), y = (unsigned)((this->points[i].y - y0) * scale);
+            // Hilbert index, https://en.wikipedia.org/wiki/Hilbert_curve
+            unsigned long d = 0;
+            for (unsigned s = 1u << 15; s > 0; s >>= 1) {
+                unsigned rx = (x & s) > 0, ry = (y & s) > 0;
+                d += (unsigned long)s * s * ((3 * rx) ^ ry);
+                if (ry == 0) {
+                    if (rx == 1) {
+                        x = 65535 - x;
+                        y = 65535 - y;
+                    }
+                    std::swap(x, y);
+                }
+            }
+            curve[i] = std::make_pair(d, i);
+        }
+        std::sort(curve.begin(), curve.end());
+        std::vector<int> route;
+        for (auto& c:curve) route.emplace_back(this->points[c.second].idx);
+        return route;
+    }
+    /**
+     * @brief build tours in parallel from nearest neighbor at several start cities, greedy edge and
+     * a space filling curve, improve each by LocalSearch() and keep the best. Every task builds its
+     * own grid, visited set and candidate lists, the points are only read. The number of nearest 
+     * neighbor starts grows with the pool, so more cores try more tours in the same time. A task
+     * starting its local search gets an equal share of the time left among the tasks not started
+     * yet, so the whole call ends near the deadline however many starts there are.
+     * 
+     * @param seconds time budget of the whole call
+     * @param best_route if not null, receives the best route starting from city 1
+     * @return double distance of the best route
+     */
+    double MultiStart_TSP (double seconds = 1.0, std::vector<int>* best_route = nullptr) {
+        const int n = this->size;
+        const auto deadline = std::chrono::steady_clock::now() + std::chrono::duration<double>(seconds);
+        const int starts = std::min(n, std::max(1, 2 * ThreadPool::Instance().Size() - 2));
+        // the workers and the thread waiting for the group run tasks at once
+        const int threads = ThreadPool::Instance().Size() + 1;
+        std::atomic<int> waiting(starts + 2);
+        std::mutex lock;
+        double best = -1;
+        std::vector<int> best_tour;
+        auto run = [&](std::function<std::vector<int>()> construct) {
+            std::vector<int> route = construct();
+            const int left = waiting--;
+            const double remaining = std::chrono::duration<double>(deadline - std::chrono::steady_clock::now()).count();
+            const double budget = remaining * std::min(threads, left) / left;
+            double length = budget > 0 ? LocalSearch(route, budget) : RouteLength(route);
+            std::lock_guard<std::mutex> guard(lock);
+            if (best < 0 || length < best) {
+                best = length;
+                best_tour.swap(route);
+            }
+        };
+        {
+            TaskGroup group;
+            group.Run([&]{ run([this]{ return GreedyEdgeRoute(); }); });
+            group.Run([&]{ run([this]{ return SpaceFillingCurveRoute(); }); });
+            for (int k = 0; k < starts; ++k) {
+                // start cities spread over the input
+                int start = 1 + (int)((long)k * n / starts);
+                group.Run([&, start]{ run([this, start]{ return NearestNeighborRoute(start); }); });
+            }
+        }
+        if (best_route) {
+            int first = std::find(best_tour.begin(), best_tour.end(), 1) - best_tour.begin();
+            std::rotate(best_tour.begin(), best_tour.begin() + first, best_tour.end());
+            *best_route = best_tour;
+        }
+        return best;
+    }
+    // length of the closed route through the city indices
+    double RouteLength (const std::vector<int>& route) {
         double ans = 0.0;
-        auto cur = this->points[0];
-        for (auto& idx:route) {
-            ans += sqrt(square_distance(this->points[idx-1], cur));
-            cur = this->points[idx-1];
+        for (size_t i = 0; i < route.size(); ++i) {
+            ans += sqrt(square_distance(this->points[route[i] - 1], this->points[route[(i + 1) % route.size()] - 1]));
         }
-        ans += sqrt(square_distance(cur, this->points[0]));
         return ans;
     }
 };
@@ -3,6 +3,11 @@
 # include <vector>
 # include <iostream>
 # include <algorithm>
+# include <cstdint>
+# include <cmath>
+# include <deque>
+# include <mutex>
+# include "thread_pool.h"
 /**
  * @brief given target value t such that there are distinct numbers x,y in the array that satisfy x+y=t
  *  
@@ -16,6 +21,97 @@ private:
         }
         std::cout << "\n";
     }
+    /**
+     * @brief LSD radix sort, at most 16 bits per pass and only as many passes as the largest value
+     * needs. The counts of every pass are taken in a single read of the input.
+     * 
+     */
+    static void RadixSort(std::vector<uint64_t>& v) {
+        const size_t n = v.size();
+        uint64_t max_value = 0;
+        for (auto x:v) max_value |= x;
+        int bits = 0;
+        while (bits < 64 && (max_value >> bits) > 0) ++bits;
+        const int passes = (bits + 15) / 16;
+        if (passes == 0) return;
+        const int digit = (bits + passes - 1) / passes;
+        const uint64_t mask = (1ULL << digit) - 1;
+        std::vector<std::vector<size_t>> offset(passes, std::vector<size_t>(mask + 2, 0));
+        for (auto x:v) {
+            for (int p = 0; p < passes; ++p) ++offset[p][((x >> (p * digit)) & mask) + 1];
+        }
+        std::vector<uint64_t> buffer(n);
+        for (int p = 0; p < passes; ++p) {
+            size_t* o = offset[p].data();
+            for (size_t d = 0; d <= mask; ++d) o[d + 1] += o[d];
+            const int shift = p * digit;
+            for (size_t i = 0; i < n; ++i) buffer[o[(v[i] >> shift) & mask]++] = v[i];
+            v.swap(buffer);
+        }
+    }
+    /**
+     * @brief number of elements taken from a in the first k elements of merge(a, b), ties from a first
+     * 
+     */
+    template <class V>
+    static long CoRank(const V* a, long na, const V* b, long nb, long k) {
+        long lo = std::max(0L, k - nb);
+        long hi = std::min(k, na);
+        while (lo < hi) {
+            long i = lo + (hi - lo)/2;
+            // b[k-i-1] should come after a[i], otherwise more elements of a are needed
+            if (!(b[k - i - 1] < a[i])) lo = i + 1;
+            else hi = i;
+        }
+        return lo;
+    }
+    /**
+     * @brief sort with the thread pool: chunks are sorted by std::sort in parallel, then merged 
+     * pairwise in rounds between the input and a buffer. Every merge is split by merge path into
+     * segments proportional to its length, so each round keeps all threads busy.
+     * 
+     * @param input 
+     */
+    template <class T>
+    void ParallelSortInput(T& input) {
+        const long n = input.size();
+        const long threads = ThreadPool::Instance().Size() + 1;
+        const long chunks = std::min(n / 4096 + 1, 2L * threads);
+        std::vector<long> bound(chunks + 1);
+        for (long c = 0; c <= chunks; ++c) bound[c] = n * c / chunks;
+        {
+            TaskGroup group;
+            for (long c = 0; c < chunks; ++c) {
+                group.Run([&, c] { std::sort(input.begin() + bound[c], input.begin() + bound[c + 1]); });
+            }
+        }
+        if (chunks == 1) return;
+        T buffer(n);
+        auto* src = input.data();
+        auto* dst = buffer.data();
+        for (long width = 1; width < chunks; width *= 2) {
+            TaskGroup group;
+            for (long c = 0; c < chunks; c += 2 * width) {
+                const long first = bound[c];
+                const long middle = bound[std::min(chunks, c + width)];
+                const long last = bound[std::min(chunks, c + 2 * width)];
+                const long segments = std::max(1L, 4 * threads * (last - first) / n);
+                for (long s = 0; s < segments; ++s) {
+                    group.Run([=] {
+                        const long k = (last - first) * s / segments;
+                        const long k_end = (last - first) * (s + 1) / segments;
+                        const long i = CoRank(src + first, middle - first, src + middle, last - middle, k);
+                        const long i_end = CoRank(src + first, middle - first, src + middle, last - middle, k_end);
+                        std::merge(src + first + i, src + first + i_end, src + middle + k - i, src + middle + k_end - i_end,
+                                   dst + first + k);
+                    });
+                }
+            }
+            group.Wait();
+            std::swap(src, dst);
+        }
+        if (src != input.data()) input.swap(buffer);
+    }
 public:
     TwoSum(){}
     /**
@@ -61,5 +157,124 @@ public:
         //printHash(hashmap, target_lower);
         return count;
     }
+    /**
+     * @brief same result as NumWithinRange() without a comparison sort. With W the width of the target
+     * range, the partners y of x lie in the buckets floor(y / W) next to floor((target_lower - x) / W).
+     * A radix sort of x - min(x) partitions the values into contiguous buckets that are sorted inside,
+     * then one pointer walks the buckets downward while x walks them upward, so each bucket is swept
+     * against its neighbours linearly and the cost is O(n + number of pairs) after the radix passes.
+     * 
+     * @param target_lower 
+     * @param target_upper 
+     * @param input array in any order
+     * @param bitmap if given, filled with bit (t - target_lower) set for every achievable target t
+     * @return int number of the targets
+     */
+    template<class T>
+    int NumWithinRangeBucket(const long long target_lower, const long long target_upper, const T& input, 
+                             std::vector<uint64_t>* bitmap = nullptr) {
+        const long long width = target_upper - target_lower + 1;
+        std::vector<uint64_t> targets((width + 63) / 64, 0);
+        std::vector<uint64_t> value(input.size());
+        if (!input.empty()) {
+            const long long base = *std::min_element(input.begin(), input.end());
+            for (size_t i = 0; i < input.size(); ++i) value[i] = (uint64_t)((long long)input[i] - base);
+            RadixSort(value);
+            value.erase(std::unique(value.begin(), value.end()), value.end());
+            // y in [target_lower - x, target_upper - x] starts at index lo, which only moves left
+            const long long n = value.size();
+            long long lo = n;
+            for (long long i = 0; i < n; ++i) {
+                const long long x = (long long)value[i] + base;
+                while (lo > 0 && (long long)value[lo - 1] + base >= target_lower - x) --lo;
+                // count each pair once, from its smaller number
+                for (long long j = std::max(lo, i + 1); j < n && (long long)value[j] + base <= target_upper - x; ++j) {
+                    const long long t = x + (long long)value[j] + base - target_lower;
+                    targets[t >> 6] |= 1ULL << (t & 63);
+                }
+            }
+        }
+        int count = 0;
+        for (auto word:targets) count += __builtin_popcountll(word);
+        if (bitmap) bitmap->swap(targets);
+        return count;
+    }
+    /**
+     * @brief multi-threaded version of NumWithinRange() with identical result. The input is sorted 
+     * in parallel, then the index range of x is split into chunks. A task claims one of the bitsets
+     * that are not in use, marks the targets x + y of its chunk and gives the bitset back, so there
+     * are only as many bitsets as tasks running at once, and they are OR-reduced at the end.
+     * 
+     * @param target_lower 
+     * @param target_upper 
+     * @param input array in any order, sorted after counting
+     * @return int number of the targets
+     */
+    template<class T>
+    int NumWithinRangeParallel(const long long target_lower, const long long target_upper, T& input) {
+        const long long width = target_upper - target_lower + 1;
+        const long words = (width + 63) / 64;
+        const long n = input.size();
+        ParallelSortInput(input);
+        // a few chunks per thread for load balance
+        const long threads = ThreadPool::Instance().Size() + 1;
+        const long chunks = std::min(n / 1024 + 1, 4L * threads);
+        // bitsets of the tasks, a deque keeps them in place while another one is added
+        std::deque<std::vector<uint64_t>> local;
+        std::vector<size_t> idle;
+        std::mutex slot_lock;
+        {
+            TaskGroup group;
+            for (long c = 0; c < chunks; ++c) {
+                group.Run([&, c] {
+                    size_t slot;
+                    std::vector<uint64_t>* bits;
+                    {
+                        std::lock_guard<std::mutex> guard(slot_lock);
+                        if (idle.empty()) {
+                            idle.emplace_back(local.size());
+                            local.emplace_back();
+                        }
+                        slot = idle.back();
+                        idle.pop_back();
+                        bits = &local[slot];
+                    }
+                    if (bits->empty()) bits->assign(words, 0);
+                    uint64_t* targets = bits->data();
+                    for (long l = n * c / chunks; l < n * (c + 1) / chunks; ++l) {
+                        const long long x = input[l];
+                        // every distinct x once, paired with the larger numbers y only
+                        if (l > 0 && input[l - 1] == x) continue;
+                        auto first = std::upper_bound(input.begin() + l, input.end(), x);
+                        first = std::lower_bound(first, input.end(), target_lower - x);
+                        for (auto it = first; it != input.end() && *it <= target_upper - x; ++it) {
+                            if (it != first && *it == *(it - 1)) continue;
+                            const long long t = x + *it - target_lower;
+                            targets[t >> 6] |= 1ULL << (t & 63);
+                        }
+                    }
+                    std::lock_guard<std::mutex> guard(slot_lock);
+                    idle.emplace_back(slot);
+                });
+            }
+        }
+        // OR-reduce the bitsets, word ranges in parallel
+        std::vector<int> count(chunks, 0);
+        {
+            TaskGroup group;
+            for (long c = 0; c < chunks; ++c) {
+                group.Run([&, c] {
+                    for (long w = words * c / chunks; w < words * (c + 1) / chunks; ++w) {
+                        uint64_t word = 0;
+                        for (auto& bits:local) word |= bits[w];
+                        count[c] += __builtin_popcountll(word);
+                    }
+                });
+            }
+        }
+        int ans = 0;
+        for (auto i:count) ans += i;
+        return ans;
+    }
 };
 # endif /* TWO_SUM_H_ */
\ No newline at end of file